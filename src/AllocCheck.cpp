@@ -0,0 +1,294 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#include "AllocCheck.h"
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef DEBUG_ALLOC
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <unistd.h>
+
+// current no allocation scope name, null if allocations are allowed,
+// plain pointer so reading it never allocates
+static thread_local const char *scope = nullptr;
+
+void AllocCheck::check() {
+	if(!scope) {return;}
+
+	// report without allocating
+	const char *name = scope;
+	scope = nullptr;
+	const char *message = "AllocCheck: heap allocation in ";
+	if(write(STDERR_FILENO, message, std::strlen(message)) < 0 ||
+	   write(STDERR_FILENO, name, std::strlen(name)) < 0 ||
+	   write(STDERR_FILENO, "\n", 1) < 0) {}
+	std::abort();
+}
+
+const char* AllocCheck::enter(const char *name) {
+	const char *previous = scope;
+	scope = name;
+	return previous;
+}
+
+void AllocCheck::leave(const char *previous) {
+	scope = previous;
+}
+
+//--------------------------------------------------------------
+// C allocation replacements, glibc only, forwarding to the glibc allocator
+// so its free still matches, catches allocations by C libraries and
+// containers with malloc based allocators
+
+#ifdef __GLIBC__
+
+extern "C" {
+	void* __libc_malloc(std::size_t size);
+	void* __libc_calloc(std::size_t count, std::size_t size);
+	void* __libc_realloc(void *p, std::size_t size);
+	void* __libc_memalign(std::size_t alignment, std::size_t size);
+}
+
+void* malloc(std::size_t size) noexcept {
+	AllocCheck::check();
+	return __libc_malloc(size);
+}
+
+void* calloc(std::size_t count, std::size_t size) noexcept {
+	AllocCheck::check();
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void *p, std::size_t size) noexcept {
+	AllocCheck::check();
+	return __libc_realloc(p, size);
+}
+
+int posix_memalign(void **p, std::size_t alignment, std::size_t size) noexcept {
+	AllocCheck::check();
+	if(alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) {
+		return EINVAL;
+	}
+	void *aligned = __libc_memalign(alignment, size);
+	if(!aligned) {return ENOMEM;}
+	*p = aligned;
+	return 0;
+}
+
+void* aligned_alloc(std::size_t alignment, std::size_t size) noexcept {
+	AllocCheck::check();
+	return __libc_memalign(alignment, size);
+}
+
+#endif
+
+//--------------------------------------------------------------
+// global operator new replacements, the nothrow and remaining delete forms
+// default to these
+
+// free matches the malloc in the replaced operator new, which gcc can't see
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t size) {
+	AllocCheck::check();
+	void *p = std::malloc(size > 0 ? size : 1);
+	if(!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](std::size_t size) {
+	AllocCheck::check();
+	void *p = std::malloc(size > 0 ? size : 1);
+	if(!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept {
+	std::free(p);
+}
+
+#ifdef __cpp_aligned_new
+
+// over-aligned types, ie. SIMD members, C++17
+static void* alignedNew(std::size_t size, std::align_val_t alignment) {
+	AllocCheck::check();
+	std::size_t align = std::max((std::size_t)alignment, sizeof(void*));
+	void *p = nullptr;
+	if(posix_memalign(&p, align, size > 0 ? size : 1) != 0) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	return alignedNew(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+	return alignedNew(size, alignment);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+	#pragma GCC diagnostic pop
+#endif
+
+#endif
+
+//--------------------------------------------------------------
+#ifdef DEBUG_ALLOC
+
+// keeps deliberate allocations from being optimized away
+static void * volatile allocated = nullptr;
+
+// run test in a thread of a child process, like the audio callback, with
+// stderr captured, returns true if the child aborted & its output
+static bool runCase(void (*test)(), std::string &output) {
+	int fds[2];
+	if(pipe(fds) != 0) {return false;}
+	pid_t pid = fork();
+	if(pid == 0) {
+		close(fds[0]);
+		dup2(fds[1], STDERR_FILENO);
+		std::thread thread(test);
+		thread.join();
+		_exit(0);
+	}
+	close(fds[1]);
+	char buffer[256];
+	ssize_t n;
+	while((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+		output.append(buffer, n);
+	}
+	close(fds[0]);
+	int status = 0;
+	waitpid(pid, &status, 0);
+	return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+bool AllocCheck::selfTest() {
+	struct Case {
+		const char *name;
+		void (*test)();
+		bool caught; //< expected to abort
+	};
+	const Case cases[] = {
+		{"allocation in audio thread scope", []() {
+			AllocCheck::Scope check("audio thread");
+			std::vector<float> buffer;
+			buffer.push_back(1);
+			allocated = buffer.data();
+		}, true},
+	#ifdef __GLIBC__
+		{"malloc in audio thread scope", []() {
+			AllocCheck::Scope check("audio thread");
+			allocated = std::malloc(64);
+		}, true},
+	#endif
+	#ifdef __cpp_aligned_new
+		{"aligned new in audio thread scope", []() {
+			struct alignas(64) Block {float samples[16];};
+			AllocCheck::Scope check("audio thread");
+			allocated = new Block;
+		}, true},
+	#endif
+		{"preallocated use in scope", []() {
+			std::vector<float> buffer(64);
+			AllocCheck::Scope check("audio thread");
+			buffer[0] = 1;
+			allocated = buffer.data();
+		}, false},
+		{"allowed allocation in scope", []() {
+			AllocCheck::Scope check("audio thread");
+			AllocCheck::Allow allow;
+			std::vector<float> buffer;
+			buffer.push_back(1);
+			allocated = buffer.data();
+		}, false},
+		{"allocation outside of scopes", []() {
+			std::vector<float> buffer;
+			buffer.push_back(1);
+			allocated = buffer.data();
+		}, false}
+	};
+	bool ok = true;
+	for(const auto &c : cases) {
+		std::string output;
+		bool caught = runCase(c.test, output);
+		bool named = !caught || output.find("heap allocation in audio thread") != std::string::npos;
+		bool pass = (caught == c.caught && named);
+		ok = ok && pass;
+		std::cout << "alloc check: " << c.name << ": " << (caught ? "caught" : "not caught")
+		          << (pass ? "" : " UNEXPECTED") << std::endl;
+	}
+	return ok;
+}
+
+#else
+
+bool AllocCheck::selfTest() {
+	std::cout << "alloc check: disabled, rebuild with make DEBUG_ALLOC=1" << std::endl;
+	return false;
+}
+
+#endif
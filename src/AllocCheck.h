@@ -0,0 +1,76 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+// define DEBUG_ALLOC to abort on any heap allocation inside an
+// AllocCheck::Scope, ie. in the audio thread or the inference path, replaces
+// global operator new incl. the aligned forms and, with glibc, malloc,
+// calloc, realloc, posix_memalign, & aligned_alloc, set when building via:
+// make DEBUG_ALLOC=1
+
+/// heap allocation checks for the real-time paths, no-ops unless DEBUG_ALLOC
+/// is defined, in which case an allocation inside a Scope prints the scope
+/// name and aborts, run in a debugger to get a backtrace
+class AllocCheck {
+
+	public:
+
+		/// no allocations allowed while in scope, name must be a static string
+		class Scope {
+			public:
+		#ifdef DEBUG_ALLOC
+				explicit Scope(const char *name) : previous(AllocCheck::enter(name)) {}
+				~Scope() {AllocCheck::leave(previous);}
+			private:
+				const char *previous;
+		#else
+				explicit Scope(const char *) {}
+		#endif
+		};
+
+		/// allocations allowed while in scope, ie. around calls into libraries
+		/// which allocate internally
+		class Allow {
+			public:
+		#ifdef DEBUG_ALLOC
+				Allow() : previous(AllocCheck::enter(nullptr)) {}
+				~Allow() {AllocCheck::leave(previous);}
+			private:
+				const char *previous;
+		#else
+				Allow() {}
+		#endif
+		};
+
+		/// check that an allocation in an audio thread scope is caught while
+		/// allocations outside of scopes or allowed are not, each case runs
+		/// in a child process, returns true if all cases behave as expected,
+		/// always false unless built with DEBUG_ALLOC
+		static bool selfTest();
+
+	#ifdef DEBUG_ALLOC
+		/// called by the allocation replacements, aborts if in a scope
+		static void check();
+
+	private:
+
+		/// set current scope name, returns previous
+		static const char* enter(const char *name);
+
+		/// restore previous scope name
+		static void leave(const char *previous);
+	#endif
+};
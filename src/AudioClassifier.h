@@ -15,12 +15,20 @@
 
 #pragma once
 
-#include <queue>
-#include <deque>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 
-#include "ofxTensorFlow2.h"
 #include "ofFileUtils.h"
+#include "ClipTiming.h"
+#include "Dsp.h"
+#include "MemoryLock.h"
+#include "ModelSession.h"
 
 // uncomment to write recorded audio samples to bin/data/test.wav
 //#define DEBUG_WAVE
@@ -28,72 +36,306 @@
 #include "WavFileWriterBeta.h"
 #endif
 
-/// a simple Fifo with adjustable max length
-template <typename T, typename Container=std::deque<T>>
-class FixedFifo : public std::queue<T, Container> {
+typedef std::vector<float> SimpleAudioBuffer;
 
-	public:
+/// captured audio storage format, float or int16 samples optionally
+/// decimated by averaging on capture, converted back to float once when
+/// filling the model input
+typedef struct CaptureFormat {
+
+	/// stored sample type
+	enum Type {
+		FLOAT, //< 32 bit float
+		INT16  //< 16 bit signed int
+	};
+
+	Type type = FLOAT;
+	std::size_t decimation = 1; //< input samples averaged into each stored sample
 
-		FixedFifo(const std::size_t maxLength=10) : maxLen(maxLength) {}
+	/// bytes per stored sample
+	std::size_t sampleBytes() const {return (type == INT16 ? sizeof(int16_t) : sizeof(float));}
 
-		void push(const T& value) {
-			if(this->size() == maxLen) {
-				this->c.pop_front();
+	/// store length input samples into out, length / decimation samples
+	void store(const float *in, const std::size_t length, void *out) const {
+		const std::size_t outLength = length / decimation;
+		if(type == INT16) {
+			int16_t *dest = (int16_t *)out;
+			if(decimation > 1) {
+				// decimate in stack chunks to keep the audio thread allocation free
+				float chunk[256];
+				for(std::size_t i = 0; i < outLength; i += 256) {
+					std::size_t n = std::min(outLength - i, (std::size_t)256);
+					dsp().decimate(&in[i * decimation], n, decimation, chunk);
+					dsp().floatToInt16(chunk, n, 32767.0f, &dest[i]);
+				}
+			}
+			else {
+				dsp().floatToInt16(in, outLength, 32767.0f, dest);
 			}
-			std::queue<T, Container>::push(value);
 		}
+		else if(decimation > 1) {
+			dsp().decimate(in, outLength, decimation, (float *)out);
+		}
+		else {
+			std::memcpy(out, in, length * sizeof(float));
+		}
+	}
+
+	/// downsample length stored samples by an integer factor and convert
+	/// to float into out, length / factor samples
+	void load(const void *in, const std::size_t length, const std::size_t factor, float *out) const {
+		const std::size_t outLength = length / factor;
+		if(type == INT16) {
+			dsp().decimateInt16((const int16_t *)in, outLength, factor, 1.0f / (32767.0f * factor), out);
+		}
+		else {
+			dsp().decimate((const float *)in, outLength, factor, out);
+		}
+	}
+
+	/// parse format name: "float", "int16", or "int16ds" which is int16
+	/// downsampled to the model samplerate by downsamplingFactor on capture,
+	/// returns true on success
+	static bool parse(const std::string & name, const std::size_t downsamplingFactor, CaptureFormat & format) {
+		if(name == "float") {format = CaptureFormat();}
+		else if(name == "int16") {format.type = INT16; format.decimation = 1;}
+		else if(name == "int16ds") {format.type = INT16; format.decimation = std::max(downsamplingFactor, (std::size_t)1);}
+		else {return false;}
+		return true;
+	}
+} CaptureFormat;
+
+/// preallocated clip of fixed size audio buffers in a capture format,
+/// filled in order
+class ClipBuffer {
+
+	public:
+
+		/// allocate room for numBuffers buffers of bufferSize input samples
+		/// each, stored in format
+		void setup(const std::size_t numBuffers, const std::size_t bufferSize,
+		           const CaptureFormat & format=CaptureFormat()) {
+			this->format = format;
+			this->numBuffers = numBuffers;
+			this->bufferSize = bufferSize / format.decimation;
+			bufferBytes = this->bufferSize * format.sampleBytes();
+			samples.assign(numBuffers * bufferBytes, 0);
+			count = 0;
+		}
+
+		/// append a buffer of input samples, returns false if full
+		bool push(const float *buffer) {
+			if(count == numBuffers) {return false;}
+			format.store(buffer, bufferSize * format.decimation, &samples[count * bufferBytes]);
+			count++;
+			return true;
+		}
+
+		/// append an already stored buffer in the same format,
+		/// returns false if full
+		bool pushStored(const void *buffer) {
+			if(count == numBuffers) {return false;}
+			std::memcpy(&samples[count * bufferBytes], buffer, bufferBytes);
+			count++;
+			return true;
+		}
+
+		/// empty clip, keeps memory
+		void clear() {count = 0;}
+
+		/// number of buffers in clip
+		std::size_t size() const {return count;}
+
+		/// max number of buffers
+		std::size_t capacity() const {return numBuffers;}
+
+		/// returns true if the clip holds numBuffers buffers
+		bool isFull() const {return count == numBuffers;}
 
+		/// stored samples per buffer
+		std::size_t getBufferSize() const {return bufferSize;}
+
+		/// stored sample format
+		const CaptureFormat & getFormat() const {return format;}
+
+		/// stored buffer samples by index
+		const void* buffer(const std::size_t index) const {return &samples[index * bufferBytes];}
+
+		/// allocated bytes
+		std::size_t getMemorySize() const {return samples.size();}
+
+		/// lock clip memory into RAM
+		void lock(MemoryLock & memory) const {
+			memory.lock(samples.data(), samples.size());
+		}
+
+	private:
+
+		std::vector<char> samples;
+		CaptureFormat format;
+		std::size_t numBuffers = 0;
+		std::size_t bufferSize = 0;
+		std::size_t bufferBytes = 0;
+		std::size_t count = 0;
+};
+
+/// preallocated ring of the most recent fixed size audio buffers in a
+/// capture format
+class BufferRing {
+
+	public:
+
+		/// allocate room for numBuffers buffers of bufferSize input samples
+		/// each, stored in format
+		void setup(const std::size_t numBuffers, const std::size_t bufferSize,
+		           const CaptureFormat & format=CaptureFormat()) {
+			this->format = format;
+			this->numBuffers = numBuffers;
+			this->bufferSize = bufferSize / format.decimation;
+			bufferBytes = this->bufferSize * format.sampleBytes();
+			samples.assign(numBuffers * bufferBytes, 0);
+			clear();
+		}
+
+		/// push a buffer of input samples, overwrites oldest when full
+		void push(const float *buffer) {
+			if(numBuffers == 0) {return;}
+			format.store(buffer, bufferSize * format.decimation, &samples[next * bufferBytes]);
+			next = (next + 1) % numBuffers;
+			count = std::min(count + 1, numBuffers);
+		}
+
+		/// empty ring, keeps memory
 		void clear() {
-			while(!this->empty()) {
-				this->pop();
+			next = 0;
+			count = 0;
+		}
+
+		/// number of buffers in ring
+		std::size_t size() const {return count;}
+
+		/// append buffers to clip in the same format from oldest to newest,
+		/// skips the oldest if the clip can't hold all of them
+		void copyTo(ClipBuffer & clip) const {
+			std::size_t room = clip.capacity() - clip.size();
+			for(std::size_t i = (count > room ? count - room : 0); i < count; i++) {
+				clip.pushStored(&samples[((next + numBuffers - count + i) % numBuffers) * bufferBytes]);
 			}
 		}
 
-		void setMaxLen(const std::size_t maxLength) {
-			maxLen = maxLength;
+		/// allocated bytes
+		std::size_t getMemorySize() const {return samples.size();}
+
+		/// lock ring memory into RAM
+		void lock(MemoryLock & memory) const {
+			memory.lock(samples.data(), samples.size());
 		}
 
 	private:
 
-		std::size_t maxLen;
+		std::vector<char> samples;
+		CaptureFormat format;
+		std::size_t numBuffers = 0;
+		std::size_t bufferSize = 0;
+		std::size_t bufferBytes = 0;
+		std::size_t next = 0;
+		std::size_t count = 0;
 };
 
-typedef std::vector<float> SimpleAudioBuffer;
-typedef FixedFifo<SimpleAudioBuffer> AudioBufferFifo;
-
-/// custom ofxTF2::Model implementation to handle audio sample conversion, etc
-class AudioClassifier : public ofxTF2::Model {
+/// audio model session wrapper to handle audio sample conversion, etc
+///
+/// holds a pool of one or more model session replicas so clips can be
+/// classified concurrently from multiple threads, each call runs on whichever
+/// replica is idle
+///
+/// clips are downsampled straight into each replica's preallocated input
+/// tensors, so classifying makes no allocations outside of TensorFlow once
+/// reserve() is called and output vectors have room for maxClasses
+class AudioClassifier {
 
 	public:
 
-		void classify(AudioBufferFifo & bufferFifo, const std::size_t downsamplingFactor,
-					  int & argMax, float & prob, std::vector<float>  & outputVector) {
+		/// max number of output classes to reserve room for
+		static const std::size_t maxClasses = 64;
+
+		/// load model from bin/data directory with session settings and
+		/// number of session replicas, returns true on success
+		bool load(const std::string & modelName, const SessionSettings & settings=SessionSettings(),
+		          const std::size_t replicas=1) {
+			std::lock_guard<std::mutex> lock(mutex);
+			sessions.clear();
+			idleSessions.clear();
+			for(std::size_t i = 0; i < std::max(replicas, (std::size_t)1); i++) {
+				std::unique_ptr<Replica> replica(new Replica);
+				if(!replica->session.load(ofToDataPath(modelName, true), settings)) {
+					return false;
+				}
+				idleSessions.push_back(replica.get());
+				sessions.push_back(std::move(replica));
+			}
+			return true;
+		}
 
-			SimpleAudioBuffer sample;
+		/// number of loaded session replicas
+		std::size_t getNumReplicas() const {return sessions.size();}
 
-			// downsample and empty the incoming Fifo
-			downsample(bufferFifo, sample, downsamplingFactor);
-			normalize(sample);
+		/// preallocate input & output memory on each replica for clips of
+		/// given downsampled length in batches of up to maxBatch clips,
+		/// call after load() and before classifying
+		void reserve(const std::size_t length, const std::size_t maxBatch) {
+			std::lock_guard<std::mutex> lock(mutex);
+			for(auto & replica : sessions) {
+				replica->session.reserve(maxBatch, length);
+				replica->output.reserve(maxBatch * maxClasses);
+			}
+		}
 
-#ifdef DEBUG_WAVE
-			sakado::WavFileWriterBeta wfw(ofToDataPath("test.wav"), 1, 16000, 2, sample.size());
-			int16_t buf;
-			for(int i = 0; i < sample.size(); i++) {
-				buf = sample[i] * 25500; // scale data to int16 range
-				wfw.write(&buf, 2, 1);
+		/// lock reserved input & output memory of each replica into RAM,
+		/// call after reserve()
+		void lock(MemoryLock & memory) {
+			std::lock_guard<std::mutex> lock(mutex);
+			for(auto & replica : sessions) {
+				replica->session.lock(memory);
+				memory.lock(replica->output.data(), replica->output.capacity() * sizeof(float));
 			}
-			wfw.close();
-#endif
+		}
 
-			// convert recorded sample to a batch of size one
-			ofxTF2::shapeVector tensorShape {1, static_cast<ofxTF2::shape_t>(sample.size()), 1};
-			auto input = ofxTF2::vectorToTensor(sample, tensorShape);
+		/// run inference on a constant input of given length on each idle replica,
+		/// the inital inference involves initalization (takes longer) and
+		/// running it again after long idle periods reloads evicted weights,
+		/// safe to call from multiple threads
+		void warmUp(const std::size_t length) {
+			std::vector<Replica*> idle;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				idle = idleSessions;
+				idleSessions.clear(); // keeps capacity so release() doesn't allocate
+			}
+			for(auto replica : idle) {
+				float *sample = replica->session.inputData(1, length);
+				std::fill(sample, sample + length, 1.0f);
+				replica->session.run(1, length, replica->output);
+				release(replica);
+			}
+		}
 
-			// inference
-			auto output = runModel(input);
+		/// classify recorded clip, sets acquired, prepared, & inferred
+		/// timestamps if timing is given, safe to call from multiple threads
+		void classify(const ClipBuffer & clip, const std::size_t downsamplingFactor,
+					  int & argMax, float & prob, std::vector<float>  & outputVector,
+					  ClipTiming *timing=nullptr) {
 
-			// convert the output to std::vector
-			ofxTF2::tensorToVector(output, outputVector);
+			// inference on recorded sample as a batch of size one
+			Replica *replica = acquire();
+			if(timing) {timing->acquired = std::chrono::steady_clock::now();}
+			const std::size_t length = sampleLength(clip, downsamplingFactor);
+			prepare(clip, replica->session.inputData(1, length), downsamplingFactor);
+			if(timing) {timing->prepared = std::chrono::steady_clock::now();}
+			if(!replica->session.run(1, length, outputVector)) {
+				outputVector.assign(1, 0.0f); // treat as noise
+			}
+			release(replica);
+			if(timing) {timing->inferred = std::chrono::steady_clock::now();}
 
 			// get element with highest probabilty
 			auto maxIt = std::max_element(outputVector.begin(), outputVector.end());
@@ -101,55 +343,125 @@ class AudioClassifier : public ofxTF2::Model {
 			prob = *maxIt;
 		}
 
-	private:
+		/// classify a batch of equal length recorded clips in a single inference
+		/// run, sets argMax, prob, and outputVector for each clip and the
+		/// batch's acquired, prepared, & inferred timestamps if timing is given,
+		/// safe to call from multiple threads
+		void classifyBatch(const std::vector<const ClipBuffer*> & clips, const std::size_t downsamplingFactor,
+		                   std::vector<int> & argMax, std::vector<float> & prob,
+		                   const std::vector<std::vector<float>*> & outputVectors,
+		                   ClipTiming *timing=nullptr) {
 
-		// inplace normalization
-		void normalize(SimpleAudioBuffer & sample) {
-			// find absolute maximum value
-			float max = 0.0;
-			for(const auto& s : sample) {
-				if(abs(s) > max) {
-					max = abs(s);
-				}
+			// stack clips into the input tensor
+			Replica *replica = acquire();
+			if(timing) {timing->acquired = std::chrono::steady_clock::now();}
+			const std::size_t length = sampleLength(*clips[0], downsamplingFactor);
+			float *samples = replica->session.inputData(clips.size(), length);
+			for(std::size_t i = 0; i < clips.size(); i++) {
+				prepare(*clips[i], samples + i * length, downsamplingFactor);
 			}
-			if(max == 0.0) {
-				return;
+			if(timing) {timing->prepared = std::chrono::steady_clock::now();}
+
+			// inference on all clips at once
+			std::vector<float> & outputVector = replica->output;
+			if(!replica->session.run(clips.size(), length, outputVector)) {
+				outputVector.assign(clips.size(), 0.0f); // treat as noise
 			}
-			for(auto&& s : sample) {
-				s /= max;
+			if(timing) {timing->inferred = std::chrono::steady_clock::now();}
+
+			// split results per clip & get element with highest probabilty
+			const std::size_t numClasses = outputVector.size() / clips.size();
+			argMax.resize(clips.size());
+			prob.resize(clips.size());
+			for(std::size_t i = 0; i < clips.size(); i++) {
+				auto begin = outputVector.begin() + i * numClasses;
+				std::vector<float> & clipOutput = *outputVectors[i];
+				clipOutput.assign(begin, begin + numClasses);
+				auto maxIt = std::max_element(clipOutput.begin(), clipOutput.end());
+				argMax[i] = std::distance(clipOutput.begin(), maxIt);
+				prob[i] = *maxIt;
 			}
+			release(replica);
 		}
 
-		// downsample by an integer
-		void downsample(AudioBufferFifo & bufferFifo, SimpleAudioBuffer & sample,
+	private:
+
+		/// session replica with its batch output buffer
+		struct Replica {
+			ModelSession session;
+			std::vector<float> output;
+		};
+
+		std::vector<std::unique_ptr<Replica>> sessions; //< session replicas
+		std::vector<Replica*> idleSessions; //< replicas not running inference
+		std::mutex mutex;
+		std::condition_variable condvar;
+
+		// wait for and take an idle replica
+		Replica* acquire() {
+			std::unique_lock<std::mutex> lock(mutex);
+			condvar.wait(lock, [&]() {return !idleSessions.empty();});
+			Replica *replica = idleSessions.back();
+			idleSessions.pop_back();
+			return replica;
+		}
+
+		// return replica to the idle list
+		void release(Replica *replica) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				idleSessions.push_back(replica);
+			}
+			condvar.notify_one();
+		}
+
+		// remaining downsampling factor for a clip, which may already be
+		// decimated on capture
+		std::size_t clipFactor(const ClipBuffer & clip, const std::size_t downsamplingFactor) {
+			return std::max(downsamplingFactor / clip.getFormat().decimation, (std::size_t)1);
+		}
+
+		// downsampled sample length for a clip
+		std::size_t sampleLength(const ClipBuffer & clip, const std::size_t downsamplingFactor) {
+			return clip.size() * (clip.getBufferSize() / clipFactor(clip, downsamplingFactor));
+		}
+
+		// downsample & normalize clip into sample which must have room for
+		// sampleLength() samples
+		void prepare(const ClipBuffer & clip, float * sample,
+		             const std::size_t downsamplingFactor) {
+			downsample(clip, sample, downsamplingFactor);
+			normalize(sample, sampleLength(clip, downsamplingFactor));
+
+#ifdef DEBUG_WAVE
+			std::size_t length = sampleLength(clip, downsamplingFactor);
+			sakado::WavFileWriterBeta wfw(ofToDataPath("test.wav"), 1, 16000, 2, length);
+			int16_t buf;
+			for(int i = 0; i < length; i++) {
+				buf = sample[i] * 25500; // scale data to int16 range
+				wfw.write(&buf, 2, 1);
+			}
+			wfw.close();
+#endif
+		}
+
+		// inplace normalization
+		void normalize(float * sample, const std::size_t length) {
+			dsp().normalize(sample, length);
+		}
+
+		// downsample by an integer, converting stored samples to float
+		void downsample(const ClipBuffer & clip, float * sample,
 						const std::size_t downsamplingFactor) {
 
 			// get the size of an element
-			const std::size_t bufferSize = bufferFifo.front().size();
-			const std::size_t bufferSizeDownsampled = bufferSize / downsamplingFactor;
-
-			// allocate memory if neccessary
-			sample.resize(bufferFifo.size() * bufferSizeDownsampled);
-
-			// pop elements from the bufferFifo, downsample and save to flat buffer
-			std::size_t i = 0;
-			while(!bufferFifo.empty()) {
-
-				// get a buffer from fifo
-				const SimpleAudioBuffer & buffer = bufferFifo.front();
-
-				// downsample by integer
-				for(std::size_t j = 0; j < bufferSizeDownsampled; j++) {
-					std::size_t offset = j * downsamplingFactor;
-					float sum = 0.0;
-					for(std::size_t k = 0; k < downsamplingFactor; k++) {
-						sum += buffer[offset+k];
-					}
-					sample[i*bufferSizeDownsampled + j] = sum / downsamplingFactor;
-				}
-				// remove buffer from fifo
-				bufferFifo.pop();
-				i++;
+			const std::size_t factor = clipFactor(clip, downsamplingFactor);
+			const std::size_t bufferSize = clip.getBufferSize();
+			const std::size_t bufferSizeDownsampled = bufferSize / factor;
+
+			// downsample each buffer and save to flat buffer
+			for(std::size_t i = 0; i < clip.size(); i++) {
+				clip.getFormat().load(clip.buffer(i), bufferSize, factor, &sample[i*bufferSizeDownsampled]);
 			}
 		}
 };
@@ -0,0 +1,147 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#include "Autotuner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#include "ofMain.h"
+#include "config.h"
+
+bool Autotuner::tune(const std::string &modelPath, SessionSettings settings,
+                     std::size_t length, int maxThreads, Objective objective,
+                     Result &result) {
+
+	// powers of 2 up to and including max
+	std::vector<int> threadCounts;
+	if(fixedThreads > 0) {
+		threadCounts.push_back(fixedThreads);
+	}
+	else {
+		for(int t = 1; t < maxThreads; t *= 2) {
+			threadCounts.push_back(t);
+		}
+		threadCounts.push_back(std::max(maxThreads, 1));
+	}
+
+	bool found = false;
+	settings.perSessionThreads = true; // pools sized by each run's settings
+	for(auto threads : threadCounts) {
+		settings.intraOpThreads = threads;
+		ModelSession session;
+		if(!session.load(modelPath, settings)) {
+			return false;
+		}
+		for(auto batchSize : batchSizes) {
+			std::vector<float> input(batchSize * length, 1.0f), output;
+			session.run(input.data(), batchSize, length, output); // warm up
+
+			// median run time
+			std::vector<float> times;
+			for(std::size_t i = 0; i < runs; i++) {
+				auto start = std::chrono::steady_clock::now();
+				if(!session.run(input.data(), batchSize, length, output)) {
+					return false;
+				}
+				times.push_back(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+			}
+			std::sort(times.begin(), times.end());
+			Result r;
+			r.threads = threads;
+			r.batchSize = batchSize;
+			r.latency = times[times.size() / 2];
+			r.throughput = batchSize * 1000.0f / r.latency;
+			ofLogVerbose(PACKAGE) << "autotune: " << threads << " thread(s) batch " << batchSize << ": "
+			                      << ofToString(r.latency, 1) << " ms "
+			                      << ofToString(r.throughput, 1) << " clips/s";
+
+			// best so far?
+			bool better = !found;
+			if(found) {
+				switch(objective) {
+					case LATENCY:
+						// only single clips count for latency, prefer fewer threads if equal
+						better = (batchSize == 1 && r.latency < result.latency);
+						break;
+					case THROUGHPUT:
+						better = (r.throughput > result.throughput);
+						break;
+				}
+			}
+			if(better) {
+				result = r;
+				found = true;
+			}
+		}
+	}
+	return found;
+}
+
+bool Autotuner::load(const std::string &file, const std::string &key, Result &result) {
+	std::ifstream stream(file);
+	std::string line;
+	while(std::getline(stream, line)) {
+		std::istringstream fields(line);
+		std::string k;
+		Result r;
+		if(fields >> k >> r.threads >> r.batchSize >> r.latency >> r.throughput && k == key) {
+			result = r;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Autotuner::save(const std::string &file, const std::string &key, const Result &result) {
+
+	// keep other keys
+	std::vector<std::string> lines;
+	{
+		std::ifstream stream(file);
+		std::string line;
+		while(std::getline(stream, line)) {
+			if(line.compare(0, key.size() + 1, key + " ") != 0) {
+				lines.push_back(line);
+			}
+		}
+	}
+
+	std::ofstream stream(file, std::ios::trunc);
+	if(!stream.is_open()) {
+		return false;
+	}
+	for(auto &line : lines) {
+		stream << line << std::endl;
+	}
+	stream << key << " " << result.threads << " " << result.batchSize << " "
+	       << result.latency << " " << result.throughput << std::endl;
+	return stream.good();
+}
+
+bool Autotuner::parseObjective(const std::string &name, Objective &objective) {
+	if(name == "latency") {
+		objective = LATENCY;
+	}
+	else if(name == "throughput") {
+		objective = THROUGHPUT;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,66 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "ModelSession.h"
+
+/// startup tuner for model thread count and inference batch size,
+/// times warm up inference over a small grid of settings
+class Autotuner {
+
+	public:
+
+		/// what to optimize for
+		enum Objective {
+			LATENCY,   //< lowest time for a single clip
+			THROUGHPUT //< most clips per second
+		};
+
+		/// tuned setting and its measurements
+		typedef struct Result {
+			int threads = 0;            //< intra-op threads
+			std::size_t batchSize = 1;  //< clips per inference run
+			float latency = 0;          //< ms per inference run
+			float throughput = 0;       //< clips per second
+		} Result;
+
+		/// time model at modelPath with input length for each thread count
+		/// up to maxThreads, or only fixedThreads if set, and each batch size,
+		/// settings are used as the base
+		/// for each run, sets the best result for the objective
+		/// returns true on success
+		bool tune(const std::string &modelPath, SessionSettings settings,
+		          std::size_t length, int maxThreads, Objective objective,
+		          Result &result);
+
+		/// load cached result for key from file, returns true if found
+		static bool load(const std::string &file, const std::string &key, Result &result);
+
+		/// save result for key to file, replaces existing key
+		/// returns true on success
+		static bool save(const std::string &file, const std::string &key, const Result &result);
+
+		/// parse objective name: "latency" or "throughput",
+		/// returns true on success
+		static bool parseObjective(const std::string &name, Objective &objective);
+
+		std::vector<std::size_t> batchSizes = {1, 2, 4}; //< batch sizes to try
+		std::size_t runs = 3; //< timed runs per setting, median is used
+		int fixedThreads = 0; //< only try this intra-op thread count if > 0, ie. set explicitly
+};
@@ -0,0 +1,152 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AudioClassifier.h"
+
+/// recorded clip waiting for inference
+typedef struct Clip {
+	const ClipBuffer *buffers = nullptr; //< recorded buffers, valid until the detector slot is finished
+	int stream = 0;          //< source stream, ie. input channel
+	int slot = -1;           //< detector slot
+	std::chrono::steady_clock::time_point queued; //< time clip was queued
+	ClipTiming timing;       //< recording timestamps
+} Clip;
+
+/// bounded clip queue in front of the model with a load shedding policy,
+/// keeps counters so overload is visible instead of growing latency,
+/// clips are kept in a preallocated ring so queueing makes no allocations
+class ClipQueue {
+
+	public:
+
+		/// what to do when the queue is full
+		enum Policy {
+			DROP_OLDEST, //< drop the oldest queued clip, favors fresh results
+			DROP_NEWEST, //< drop the incoming clip, favors finishing work in order
+			COALESCE     //< replace a queued clip from the same stream, else drop oldest,
+			             //  only when full
+		};
+
+		/// set max number of queued clips & full queue policy
+		void setup(std::size_t capacity, Policy policy) {
+			std::lock_guard<std::mutex> lock(mutex);
+			clips.assign(std::max(capacity, (std::size_t)1), Clip());
+			head = 0;
+			count = 0;
+			depth.store(0, std::memory_order_relaxed);
+			this->policy = policy;
+		}
+
+		/// queue clip, sets dropped to a dropped clip if any
+		/// returns true if a clip was dropped
+		bool push(Clip && clip, Clip & dropped) {
+			clip.queued = std::chrono::steady_clock::now();
+			pushed++;
+			std::lock_guard<std::mutex> lock(mutex);
+			if(count < clips.size()) {
+				at(count) = std::move(clip);
+				count++;
+				depth.store(count, std::memory_order_relaxed);
+				return false;
+			}
+			if(policy == COALESCE) {
+				for(std::size_t i = 0; i < count; i++) {
+					Clip & queuedClip = at(i);
+					if(queuedClip.stream == clip.stream) {
+						dropped = std::move(queuedClip);
+						queuedClip = std::move(clip);
+						coalesced++;
+						return true;
+					}
+				}
+			}
+			if(policy == DROP_NEWEST) {
+				dropped = std::move(clip);
+			}
+			else {
+				dropped = std::move(at(0));
+				at(0) = std::move(clip);
+				head = (head + 1) % clips.size(); // old front is now the back
+			}
+			this->dropped++;
+			return true;
+		}
+
+		/// take up to max clips in queued order, returns number taken
+		std::size_t pop(std::vector<Clip> & taken, std::size_t max) {
+			auto now = std::chrono::steady_clock::now();
+			std::lock_guard<std::mutex> lock(mutex);
+			std::size_t num = 0;
+			while(count > 0 && num < max) {
+				Clip & clip = at(0);
+				uint64_t wait = std::chrono::duration_cast<std::chrono::microseconds>(now - clip.queued).count();
+				waitTotal += wait;
+				if(wait > waitMax) {
+					waitMax = wait;
+				}
+				taken.push_back(std::move(clip));
+				head = (head + 1) % clips.size();
+				count--;
+				num++;
+			}
+			depth.store(count, std::memory_order_relaxed);
+			popped += num;
+			return num;
+		}
+
+		/// number of queued clips
+		std::size_t size() {
+			std::lock_guard<std::mutex> lock(mutex);
+			return count;
+		}
+
+		/// parse policy name: "oldest", "newest", or "coalesce",
+		/// returns true on success
+		static bool parsePolicy(const std::string & name, Policy & policy) {
+			if(name == "oldest") {policy = DROP_OLDEST;}
+			else if(name == "newest") {policy = DROP_NEWEST;}
+			else if(name == "coalesce") {policy = COALESCE;}
+			else {return false;}
+			return true;
+		}
+
+		// counters
+		std::atomic<uint64_t> pushed{0};    //< clips queued
+		std::atomic<uint64_t> popped{0};    //< clips taken for inference
+		std::atomic<uint64_t> dropped{0};   //< clips dropped when full
+		std::atomic<uint64_t> coalesced{0}; //< clips replaced by a newer one
+		std::atomic<uint64_t> waitTotal{0}; //< total queue wait in us
+		std::atomic<uint64_t> waitMax{0};   //< max queue wait in us
+		std::atomic<uint64_t> depth{0};     //< number of queued clips, readable without the lock
+
+	private:
+
+		/// queued clip by index from the front
+		Clip & at(std::size_t index) {return clips[(head + index) % clips.size()];}
+
+		std::mutex mutex;
+		std::vector<Clip> clips = std::vector<Clip>(4); //< ring
+		std::size_t head = 0;  //< front index
+		std::size_t count = 0; //< queued clips
+		Policy policy = DROP_OLDEST;
+};
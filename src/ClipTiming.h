@@ -0,0 +1,89 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+/// monotonic timestamps of a clip passing through the pipeline, stages which
+/// were not reached are left at the epoch
+typedef struct ClipTiming {
+
+	typedef std::chrono::steady_clock::time_point Time;
+
+	/// stage durations between timestamps
+	enum Stage {
+		RECORD,  //< triggered -> recorded: clip recording incl. previous buffers
+		TAKE,    //< recorded -> queued: pickup by the main thread
+		QUEUE,   //< queued -> started: wait for an inference thread
+		REPLICA, //< started -> acquired: wait for an idle model replica
+		DSP,     //< acquired -> prepared: downsample & normalize
+		MODEL,   //< prepared -> inferred: model run
+		HANDOFF, //< inferred -> processed: pickup by the main thread
+		OUTPUT,  //< processed -> output: result handling & command posting
+		TOTAL,   //< triggered -> output
+		NUM_STAGES
+	};
+
+	Time triggered; //< recording started, audio thread
+	Time recorded;  //< recording complete, audio thread
+	Time queued;    //< queued for inference, main thread
+	Time started;   //< taken from the queue, inference thread
+	Time acquired;  //< model replica acquired, inference thread
+	Time prepared;  //< model input prepared, inference thread
+	Time inferred;  //< model run finished, inference thread
+	Time processed; //< result handling started, main thread
+	Time output;    //< result posted to outputs & command, main thread
+
+	/// stage duration in ms, 0 if either timestamp is unset
+	float getDuration(Stage stage) const {
+		switch(stage) {
+			case RECORD: return between(triggered, recorded);
+			case TAKE: return between(recorded, queued);
+			case QUEUE: return between(queued, started);
+			case REPLICA: return between(started, acquired);
+			case DSP: return between(acquired, prepared);
+			case MODEL: return between(prepared, inferred);
+			case HANDOFF: return between(inferred, processed);
+			case OUTPUT: return between(processed, output);
+			case TOTAL: return between(triggered, output);
+			default: return 0;
+		}
+	}
+
+	/// short stage name, ie. "model"
+	static const char* getStageName(Stage stage) {
+		switch(stage) {
+			case RECORD: return "record";
+			case TAKE: return "take";
+			case QUEUE: return "queue";
+			case REPLICA: return "replica";
+			case DSP: return "dsp";
+			case MODEL: return "model";
+			case HANDOFF: return "handoff";
+			case OUTPUT: return "output";
+			case TOTAL: return "total";
+			default: return "";
+		}
+	}
+
+	/// ms between two timestamps, 0 if either is unset
+	static float between(Time from, Time to) {
+		if(from == Time() || to == Time()) {return 0;}
+		return std::chrono::duration<float, std::milli>(to - from).count();
+	}
+
+} ClipTiming;
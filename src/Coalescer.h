@@ -0,0 +1,86 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/// detection coalescer, merges repeated same-language detections per stream
+///
+/// a detection is suppressed if the stream detected the same language less
+/// than window seconds before, so continuous speech only produces an event
+/// when the language changes or after a pause, while keepalive re-sends the
+/// same language periodically so consumers know it is still current
+///
+/// main thread only
+class Coalescer {
+
+	public:
+
+		/// set window & keepalive in seconds, 0 disables coalescing or keepalives
+		void setup(float window, float keepalive) {
+			this->window = window;
+			this->keepalive = keepalive;
+			streams.clear();
+		}
+
+		/// returns true if coalescing is enabled
+		bool isEnabled() const {return window > 0;}
+
+		/// detection of label index on stream at time in seconds,
+		/// returns true if it should be output or false if suppressed
+		bool pass(int stream, int index, float time) {
+			if(window <= 0 || stream < 0) {
+				passed++;
+				return true;
+			}
+			if((std::size_t)stream >= streams.size()) {
+				streams.resize(stream + 1);
+			}
+			Stream & s = streams[stream];
+			bool repeated = (index == s.index && time - s.detected < window);
+			s.detected = time;
+			if(repeated && (keepalive <= 0 || time - s.output < keepalive)) {
+				suppressed++;
+				return false;
+			}
+			s.index = index;
+			s.output = time;
+			passed++;
+			return true;
+		}
+
+		/// forget last detections, ie. when listening restarts
+		void reset() {
+			streams.clear();
+		}
+
+		uint64_t passed = 0;     //< detections output
+		uint64_t suppressed = 0; //< repeated detections suppressed
+
+	private:
+
+		/// per stream state
+		typedef struct Stream {
+			int index = -1;    //< last output label index
+			float detected = 0; //< last detection time
+			float output = 0;   //< last output time
+		} Stream;
+
+		float window = 0;    //< seconds, 0 to disable
+		float keepalive = 0; //< seconds, 0 to disable
+		std::vector<Stream> streams; //< by stream index
+};
@@ -0,0 +1,306 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#include "CommandProcess.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ofMain.h"
+#include "config.h"
+
+extern char **environ;
+
+// child uptime in seconds below which the restart delay is doubled
+static const int minUptime = 5;
+
+// max restart delay in seconds
+static const int maxBackoff = 30;
+
+//--------------------------------------------------------------
+void CommandProcess::start(const std::string & command, std::function<void()> init, std::size_t maxQueued) {
+	stop(std::chrono::steady_clock::now());
+	this->command = command;
+	this->maxQueued = std::max(maxQueued, (std::size_t)1);
+	stopping = false;
+	finishing = false;
+	unwritten = 0;
+	backoff = std::chrono::seconds(1);
+
+	// a child exiting mid write must not kill us
+	signal(SIGPIPE, SIG_IGN);
+
+	thread = std::thread([this, init]() {run(init);});
+}
+
+std::size_t CommandProcess::stop(std::chrono::steady_clock::time_point deadline) {
+	if(!thread.joinable()) {return unwritten;}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		this->deadline = deadline;
+	}
+	condition.notify_one();
+	thread.join();
+	return unwritten;
+}
+
+bool CommandProcess::post(std::string line) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!thread.joinable() || stopping) {return false;}
+		if(lines.size() >= maxQueued) {
+			lines.pop_front();
+			dropped.fetch_add(1, std::memory_order_relaxed);
+		}
+		line += "\n";
+		lines.push_back(std::move(line));
+	}
+	condition.notify_one();
+	return true;
+}
+
+//--------------------------------------------------------------
+void CommandProcess::run(std::function<void()> init) {
+	if(init) {init();}
+	bool first = true;
+	auto nextSpawn = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point stopDeadline;
+	while(true) {
+
+		// wait for a line, or wake up once in a while to notice child exits
+		std::string line;
+		bool haveLine = false, stop = false;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait_for(lock, std::chrono::seconds(1), [this]() {
+				return stopping || !lines.empty();
+			});
+			stop = stopping;
+			stopDeadline = deadline;
+			if(!lines.empty()) {
+				line = std::move(lines.front());
+				lines.pop_front();
+				haveLine = true;
+			}
+		}
+		auto now = std::chrono::steady_clock::now();
+
+		// supervise, schedule restart after the child exited
+		if(child > 0 && reap(false)) {
+			nextSpawn = now + restartDelay(now);
+		}
+		if(stop && (!haveLine || now >= stopDeadline || child <= 0)) {
+			if(haveLine) {
+				std::lock_guard<std::mutex> lock(mutex);
+				lines.push_front(std::move(line));
+			}
+			break;
+		}
+		if(child <= 0) {
+			if(now < nextSpawn) {
+				// keep line until restarted
+				std::unique_lock<std::mutex> lock(mutex);
+				if(haveLine) {lines.push_front(std::move(line));}
+				condition.wait_until(lock, nextSpawn, [this]() {return stopping;});
+				continue;
+			}
+			if(!spawn()) {
+				backoff = std::min(backoff * 2, std::chrono::seconds(maxBackoff));
+				nextSpawn = now + backoff;
+				if(haveLine) {
+					std::lock_guard<std::mutex> lock(mutex);
+					lines.push_front(std::move(line));
+				}
+				continue;
+			}
+			if(!first) {
+				restarts.fetch_add(1, std::memory_order_relaxed);
+			}
+			first = false;
+		}
+		if(!haveLine) {continue;}
+
+		std::size_t sent = 0;
+		if(write(line, sent)) {
+			written.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+
+		// keep an unsent line for the restarted child or the count of
+		// unwritten lines, the rest of a partly sent line would reach the
+		// restarted child without its start so drop it
+		if(sent == 0 || stop) {
+			std::lock_guard<std::mutex> lock(mutex);
+			lines.push_front(line.substr(sent));
+		}
+		else {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+		}
+		if(stop) {break;}
+		if(child > 0) {
+			// the child closed its stdin, it can't be fed anymore so
+			// terminate it to be restarted
+			ofLogWarning(PACKAGE) << "command: pid " << child << " closed its input, restarting";
+			kill(child, SIGTERM);
+			reap(true);
+			nextSpawn = std::chrono::steady_clock::now() + restartDelay(now);
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		unwritten = lines.size();
+		lines.clear();
+	}
+	finish(stopDeadline);
+}
+
+std::chrono::seconds CommandProcess::restartDelay(std::chrono::steady_clock::time_point exited) {
+	if(exited - started < std::chrono::seconds(minUptime)) {
+		backoff = std::min(backoff * 2, std::chrono::seconds(maxBackoff));
+	}
+	else {
+		backoff = std::chrono::seconds(1);
+	}
+	return backoff;
+}
+
+bool CommandProcess::spawn() {
+	int fds[2];
+	if(pipe(fds) != 0) {
+		ofLogError(PACKAGE) << "command: could not create pipe: " << std::strerror(errno);
+		return false;
+	}
+
+	// write end is ours only & must not block the supervisor
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+	posix_spawn_file_actions_addclose(&actions, fds[0]);
+
+	// SIGPIPE is ignored here, restore the default so the child's own pipes
+	// behave as in a shell
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	sigset_t defaults;
+	sigemptyset(&defaults);
+	sigaddset(&defaults, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+	char *argv[] = {(char *)"sh", (char *)"-c", (char *)command.c_str(), nullptr};
+	pid_t pid = -1;
+	int ret = posix_spawn(&pid, "/bin/sh", &actions, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+	close(fds[0]);
+	if(ret != 0) {
+		close(fds[1]);
+		ofLogError(PACKAGE) << "command: could not start: " << std::strerror(ret);
+		return false;
+	}
+	input = fds[1];
+	started = std::chrono::steady_clock::now();
+	child = pid;
+	ofLogVerbose(PACKAGE) << "command: started pid " << pid;
+	return true;
+}
+
+bool CommandProcess::reap(bool block) {
+	pid_t pid = child;
+	if(pid <= 0) {return true;}
+	int status = 0;
+	pid_t ret = waitpid(pid, &status, (block ? 0 : WNOHANG));
+	if(ret == 0) {return false;}
+	if(ret == pid) {
+		std::string text = "command: pid " + ofToString(pid) + (WIFSIGNALED(status) ?
+			" killed by signal " + ofToString(WTERMSIG(status)) :
+			" exited with status " + ofToString(WEXITSTATUS(status)));
+		if(finishing) {
+			ofLogVerbose(PACKAGE) << text;
+		}
+		else {
+			ofLogWarning(PACKAGE) << text;
+		}
+	}
+	if(input >= 0) {
+		close(input);
+		input = -1;
+	}
+	child = -1;
+	return true;
+}
+
+void CommandProcess::finish(std::chrono::steady_clock::time_point deadline) {
+	if(child <= 0) {return;}
+
+	// closing stdin tells the child to finish
+	finishing = true;
+	close(input);
+	input = -1;
+	while(std::chrono::steady_clock::now() < deadline) {
+		if(reap(false)) {return;}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	if(reap(false)) {return;}
+	ofLogWarning(PACKAGE) << "command: pid " << child << " still running, terminating";
+	kill(child, SIGTERM);
+	for(int i = 0; i < 100; i++) {
+		if(reap(false)) {return;}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	kill(child, SIGKILL);
+	reap(true);
+}
+
+bool CommandProcess::write(const std::string & line, std::size_t & sent) {
+	sent = 0;
+	while(sent < line.size()) {
+		ssize_t n = ::write(input, line.data() + sent, line.size() - sent);
+		if(n > 0) {
+			sent += n;
+			continue;
+		}
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			// pipe full, wait for the child to read unless stopping & late
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if(stopping && std::chrono::steady_clock::now() >= deadline) {
+					return false;
+				}
+			}
+			struct pollfd fd = {input, POLLOUT, 0};
+			poll(&fd, 1, 100);
+			continue;
+		}
+
+		// EPIPE, the child closed its stdin
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,110 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <sys/types.h>
+
+/// long-lived command child process fed lines on its stdin
+///
+/// the command is run once via /bin/sh by a supervisor thread which writes
+/// posted lines to the child's stdin and restarts the child if it exits,
+/// waiting 1 s before restarting & doubling up to 30 s while it keeps
+/// exiting within a few seconds, lines are kept queued meanwhile
+class CommandProcess {
+
+	public:
+
+		CommandProcess() {}
+		~CommandProcess() {stop(std::chrono::steady_clock::now());}
+
+		// non-copyable
+		CommandProcess(CommandProcess const &) = delete;
+		CommandProcess& operator=(const CommandProcess &) = delete;
+
+		/// start supervisor thread which runs command, init is called first
+		/// in the thread, ie. to apply thread settings inherited by the child,
+		/// at most maxQueued lines are kept, dropping the oldest
+		void start(const std::string & command, std::function<void()> init=nullptr,
+		           std::size_t maxQueued=256);
+
+		/// write queued lines until deadline, then close the child's stdin,
+		/// wait for it to exit until deadline & terminate it otherwise,
+		/// returns number of lines which were not written
+		std::size_t stop(std::chrono::steady_clock::time_point deadline);
+
+		/// queue line to write, a newline is appended,
+		/// returns false if not running
+		bool post(std::string line);
+
+		/// returns true if the child is running
+		bool isRunning() const {return child.load(std::memory_order_relaxed) > 0;}
+
+		std::atomic<uint64_t> written{0};  //< lines written
+		std::atomic<uint64_t> dropped{0};  //< lines dropped when the queue was full or partly written
+		std::atomic<uint64_t> restarts{0}; //< child restarts after exiting
+
+	private:
+
+		/// supervisor thread loop
+		void run(std::function<void()> init);
+
+		/// spawn child with a stdin pipe, returns true on success
+		bool spawn();
+
+		/// reap child if it exited, returns true if it did or none is running
+		bool reap(bool block);
+
+		/// close stdin, wait for child to exit until deadline, terminate it
+		/// otherwise
+		void finish(std::chrono::steady_clock::time_point deadline);
+
+		/// write line to the child until written, the child closes its stdin,
+		/// or the stop deadline passes, sets sent to the bytes written,
+		/// returns true if all were written
+		bool write(const std::string & line, std::size_t & sent);
+
+		/// returns delay before restarting a child which exited at a time,
+		/// doubled while it keeps exiting soon after starting
+		std::chrono::seconds restartDelay(std::chrono::steady_clock::time_point exited);
+
+		std::string command;
+		std::size_t maxQueued = 256;
+
+		// supervisor thread
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::deque<std::string> lines; //< queued lines, guarded by mutex
+		bool stopping = false; //< guarded by mutex
+		std::chrono::steady_clock::time_point deadline; //< stop deadline, guarded by mutex
+		std::size_t unwritten = 0; //< lines left at stop
+
+		// child, supervisor thread only except for reading the pid
+		std::atomic<pid_t> child{-1};
+		int input = -1; //< child stdin pipe write end
+		std::chrono::steady_clock::time_point started; //< last spawn time
+		std::chrono::seconds backoff{1}; //< current restart delay
+		bool finishing = false; //< stdin closed on stop, exit expected
+};
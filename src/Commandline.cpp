@@ -14,6 +14,7 @@
  */
 
 #include "Commandline.h"
+#include "AllocCheck.h"
 
 Commandline::Commandline(ofApp *app) : app(app) {
 	parser.description(DESCRIPTION);
@@ -33,12 +34,26 @@ bool Commandline::parse(int argc, char **argv) {
 	bool autostop = false;
 	bool verbose = false;
 	bool version = false;
+	bool nospin = false;
+	bool dspbench = false;
+	bool boardbench = false;
+	bool detectorstress = false;
+	bool poolbench = false;
+	bool alloctest = false;
 	std::string command = "";
+	std::string audioCores = "";
+	std::string inferenceCores = "";
+	std::string helperCores = "";
 
 	parser.add_option("-s,--senders", senders,
 		"OSC sender addr:port host pairs, ex. \"192.168.0.100:5555\" "
 		"or multicast \"239.200.200.200:6666\", default \"localhost:9999\"")->expected(-1);
 	parser.add_option("-p,--port", port, "OSC receiver port, default " + ofToString(app->port));
+	parser.add_option("-o,--output", app->outputs,
+		"outputs: osc, stdout (JSON lines), unix:PATH (binary datagrams), file:PATH (JSON lines), or shm:NAME (shared memory board), default osc")
+		->expected(-1)->check([](const std::string & spec) {
+			return (OutputSink::isValid(spec) ? std::string() : "invalid output: " + spec);
+		});
 	parser.add_option("-c,--confidence", app->minConfidence,
 		"min confidence, default " + ofToString(app->minConfidence))->transform(CLI::Bound(0.0, 1.0));
 	parser.add_option("-t,--threshold", app->volThreshold,
@@ -52,6 +67,74 @@ bool Commandline::parse(int argc, char **argv) {
 	parser.add_flag(  "--nolisten", nolisten, "do not listen on start");
 	parser.add_flag(  "--autostop", autostop, "stop listening automatically after detection");
 	parser.add_option("-e,--execute", command, "command to execute on detection with key=value pair args");
+	parser.add_flag(  "--persistent", app->persistent,
+		"run the -e command once & write detections to its stdin as JSON lines, restarting it if it exits");
+	parser.add_option("--replicas", app->replicas,
+		"model session replicas for concurrent clip inference, default " + ofToString(app->replicas))->check(CLI::Range(1, 64));
+	parser.add_option("--slots", app->numSlots,
+		"clips which can be recorded, queued, or inferred at once, each queued clip holds a slot, "
+		"default queue + replicas + 1 so the queue can fill")->check(CLI::Range(1, 64));
+	parser.add_option("--queue", app->queueSize,
+		"max clips waiting for inference, only fills with at least queue + replicas + 1 slots, "
+		"default " + ofToString(app->queueSize))->check(CLI::Range(1, 62));
+	parser.add_option("--queuepolicy", app->queuePolicy,
+		"which clip to drop when the queue is full, default " + app->queuePolicy)
+		->check(CLI::IsMember({"oldest", "newest", "coalesce"}));
+	parser.add_option("--coalesce", app->coalesceWindow,
+		"seconds within which repeated detections of the same language are merged, default 0 (off)")->check(CLI::NonNegativeNumber);
+	parser.add_option("--keepalive", app->keepalive,
+		"seconds after which a merged language is output again, default " + ofToString(app->keepalive))->check(CLI::NonNegativeNumber);
+	parser.add_option("--capture", app->captureFormat,
+		"recorded sample format, int16 halves memory & int16ds also downsamples on capture, default " + app->captureFormat)
+		->check(CLI::IsMember({"float", "int16", "int16ds"}));
+	parser.add_option("--intraop", app->sessionSettings.intraOpThreads,
+		"model threads used within a single op, default all cores split between replicas")->check(CLI::Range(0, 1024));
+	parser.add_option("--interop", app->sessionSettings.interOpThreads,
+		"model threads used to run independent ops, default all cores")->check(CLI::Range(0, 1024));
+	parser.add_flag(  "--nospin", nospin, "put idle model threads to sleep right away instead of spin waiting");
+	parser.add_flag(  "--sessionthreads", app->sessionSettings.perSessionThreads,
+		"use separate model thread pools for each replica, always on with multiple replicas");
+	parser.add_option("--autotune", app->autotune,
+		"tune model threads & batch size on startup for an objective, result is cached in bin/data/autotune.txt")
+		->check(CLI::IsMember({"latency", "throughput"}));
+	parser.add_option("--keepwarm", app->keepWarm,
+		"run a keep warm inference after this many idle seconds, default 0 (off)")->check(CLI::NonNegativeNumber);
+	parser.add_flag(  "--prewarm", app->preWarm, "run a keep warm inference when the volume starts rising");
+	parser.add_option("--helperthreads", app->helperThreads,
+		"threads for running detection commands, default " + ofToString(app->helperThreads))->check(CLI::Range(1, 64));
+	parser.add_option("--audiocores", audioCores, "cpu cores to pin the audio thread to, ex. \"0\" or \"0,1\" (linux)");
+	parser.add_option("--audiofifo", app->audioThread.fifo,
+		"real-time SCHED_FIFO priority for the audio thread if permitted, default 0 (off)")->check(CLI::Range(0, 99));
+	parser.add_option("--inferencecores", inferenceCores,
+		"cpu cores to pin inference dispatch threads to, ex. \"2-3\" (linux), "
+		"TensorFlow's own model threads are not pinned, limit them with --intraop");
+	parser.add_option("--inferencenice", app->inferenceThread.nice,
+		"nice level for inference dispatch threads, not TensorFlow's own model threads, default 0 (unchanged)")->check(CLI::Range(-20, 19));
+	parser.add_option("--helpercores", helperCores, "cpu cores to pin command threads to, ex. \"3\" (linux)");
+	parser.add_option("--helpernice", app->helperThread.nice,
+		"nice level for command threads, default 0 (unchanged)")->check(CLI::Range(-20, 19));
+	parser.add_flag(  "--lockmemory", app->lockMemory,
+		"lock audio buffers & model input/output buffers into RAM so they can't be paged out, not the model weights, see --lockall");
+	parser.add_flag(  "--lockall", app->lockAllMemory,
+		"lock all process memory into RAM, including the model weights, TensorFlow & thread stacks, implies --lockmemory (linux)");
+	parser.add_option("--drain", app->drainTimeout,
+		"max seconds to finish queued inference & commands on exit, default " + ofToString(app->drainTimeout))->check(CLI::NonNegativeNumber);
+	parser.add_option("--graphcache", app->graphCacheDir,
+		"compiled model graph cache directory for faster startup, relative to bin/data, ex. \"cache\"");
+	parser.add_flag(  "--jit", app->sessionSettings.globalJit,
+		"XLA jit compile the whole model graph, slower first start & uncached warm up");
+	parser.add_flag(  "--timing", app->outputTiming,
+		"add clip stage durations in ms to /lang messages & JSON results");
+	parser.add_option("--metrics", app->metricsPort,
+		"serve Prometheus metrics at http://127.0.0.1:PORT/metrics, default 0 (off)")->check(CLI::Range(0, 65535));
+	parser.add_flag(  "--dspbench", dspbench, "check simd audio kernels against the reference, print speedups, and exit");
+	parser.add_flag(  "--boardbench", boardbench, "time shared memory board reads against a writer and exit");
+	parser.add_flag(  "--detectorstress", detectorstress,
+		"hammer the detector state machine from an audio & a main thread, check clips, and exit");
+	parser.add_flag(  "--poolbench", poolbench, "time the work stealing thread pool against a single queue pool and exit");
+	parser.add_flag(  "--alloctest", alloctest,
+		"check that an allocation in the audio thread is caught, run a clip through the audio & inference paths, "
+		"requires a DEBUG_ALLOC build, and exit");
 	parser.add_flag(  "-v,--verbose", verbose, "verbose printing");
 	parser.add_flag(  "--version", version, "print version and exit");
 
@@ -66,12 +149,59 @@ bool Commandline::parse(int argc, char **argv) {
 	// verbose printing?
 	ofSetLogLevel(PACKAGE, (verbose ? OF_LOG_VERBOSE : OF_LOG_NOTICE));
 
+	// keep stdout for JSON lines
+	if(std::find(app->outputs.begin(), app->outputs.end(), "stdout") != app->outputs.end()) {
+		logToStderr();
+	}
+
 	// print version
 	if(version) {
 		std::cout << VERSION << std::endl;
 		return false;
 	}
 
+	// check & time audio kernels
+	if(dspbench) {
+		if(!dspBenchmark()) {
+			error = CLI::RuntimeError("dsp kernel mismatch", EXIT_FAILURE);
+		}
+		return false;
+	}
+
+	// time shared memory board contention
+	if(boardbench) {
+		if(!ResultBoard::benchmark()) {
+			error = CLI::RuntimeError("board benchmark failed", EXIT_FAILURE);
+		}
+		return false;
+	}
+
+	// check detector state machine under contention
+	if(detectorstress) {
+		if(!Detector::stress()) {
+			error = CLI::RuntimeError("detector stress test failed", EXIT_FAILURE);
+		}
+		return false;
+	}
+
+	// time thread pool & task storage
+	if(poolbench) {
+		if(!threadPoolBenchmark()) {
+			error = CLI::RuntimeError("thread pool lost tasks", EXIT_FAILURE);
+		}
+		return false;
+	}
+
+	// check allocation checks catch audio thread allocations, the real
+	// paths are run after setup
+	if(alloctest) {
+		if(!AllocCheck::selfTest()) {
+			error = CLI::RuntimeError("allocation check failed", EXIT_FAILURE);
+			return false;
+		}
+		app->allocTest = true;
+	}
+
 	// list audio input devices
 	if(list) {
 		auto devices = app->soundStream.getDeviceList();
@@ -201,6 +331,27 @@ bool Commandline::parse(int argc, char **argv) {
 		app->autostop = true;
 	}
 
+	// model thread spin waiting
+	if(nospin) {
+		app->sessionSettings.spinWait = false;
+	}
+
+	// locking all memory includes the registered buffers
+	if(app->lockAllMemory) {
+		app->lockMemory = true;
+	}
+
+	// thread cores
+	for(auto cores : {std::make_pair(audioCores, &app->audioThread),
+	                  std::make_pair(inferenceCores, &app->inferenceThread),
+	                  std::make_pair(helperCores, &app->helperThread)}) {
+		if(cores.first != "" && !parseCores(cores.first, cores.second->cores)) {
+			ofLogError(PACKAGE) << "invalid core list: " << cores.first;
+			error = CLI::RuntimeError("invalid core list", EXIT_FAILURE);
+			return false;
+		}
+	}
+
 	// command
 	if(command != "") {
 		app->command = command;
@@ -0,0 +1,226 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#include "ControlReceiver.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "ofMain.h"
+#include "config.h"
+#include "osc/OscOutboundPacketStream.h"
+#include "osc/OscReceivedElements.h"
+
+// max UDP packet size
+static const std::size_t maxPacketSize = 65536;
+
+// ms between checks for stop while no packets arrive
+static const int pollInterval = 100;
+
+//--------------------------------------------------------------
+bool ControlReceiver::start(int port, Handler handler, std::size_t maxQueued) {
+	stop();
+	socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+	if(socket < 0) {
+		ofLogError(PACKAGE) << "control: could not open socket: " << std::strerror(errno);
+		return false;
+	}
+	fcntl(socket, F_SETFD, FD_CLOEXEC); // not for command children
+	int reuse = 1; // allow quick restarts, as with ofxOscReceiver
+	setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	int timestamp = 1; // kernel receive time for measuring latency
+	setsockopt(socket, SOL_SOCKET, SO_TIMESTAMP, &timestamp, sizeof(timestamp));
+	struct sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if(bind(socket, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		ofLogError(PACKAGE) << "control: could not bind port " << port << ": " << std::strerror(errno);
+		close(socket);
+		socket = -1;
+		return false;
+	}
+	this->handler = handler;
+	this->maxQueued = std::max(maxQueued, (std::size_t)1);
+	running = true;
+	thread = std::thread([this]() {run();});
+	return true;
+}
+
+void ControlReceiver::stop() {
+	running = false;
+	if(thread.joinable()) {
+		thread.join();
+	}
+	if(socket >= 0) {
+		close(socket);
+		socket = -1;
+	}
+}
+
+bool ControlReceiver::getNextMessage(ofxOscMessage & message) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if(messages.empty()) {return false;}
+	message = std::move(messages.front());
+	messages.pop_front();
+	return true;
+}
+
+void ControlReceiver::logStats() const {
+	if(received == 0) {return;}
+	ofLogVerbose(PACKAGE) << "control: " << received << " message(s), latency avg "
+	                      << latencySum / received << " us max " << latencyMax << " us"
+	                      << (malformed > 0 ? ", " + ofToString(malformed.load()) + " malformed packet(s)" : "");
+}
+
+bool ControlReceiver::reply(const ofxOscMessage & request, const std::vector<ofxOscMessage> & messages) {
+	struct sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(request.getRemotePort());
+	if(socket < 0 || inet_pton(AF_INET, request.getRemoteHost().c_str(), &addr.sin_addr) != 1) {
+		return false;
+	}
+
+	// replies only carry numbers & strings
+	std::unique_ptr<char[]> buffer(new char[maxPacketSize]);
+	osc::OutboundPacketStream stream(buffer.get(), maxPacketSize);
+	try {
+		stream << osc::BeginBundleImmediate;
+		for(auto & message : messages) {
+			stream << osc::BeginMessage(message.getAddress().c_str());
+			for(std::size_t i = 0; i < message.getNumArgs(); i++) {
+				switch(message.getArgType(i)) {
+					case OFXOSC_TYPE_INT32: stream << (osc::int32)message.getArgAsInt32(i); break;
+					case OFXOSC_TYPE_INT64: stream << (osc::int64)message.getArgAsInt64(i); break;
+					case OFXOSC_TYPE_FLOAT: stream << message.getArgAsFloat(i); break;
+					case OFXOSC_TYPE_STRING: stream << message.getArgAsString(i).c_str(); break;
+					default: break;
+				}
+			}
+			stream << osc::EndMessage;
+		}
+		stream << osc::EndBundle;
+	}
+	catch(std::exception &e) {
+		ofLogWarning(PACKAGE) << "control: could not encode reply: " << e.what();
+		return false;
+	}
+	return sendto(socket, stream.Data(), stream.Size(), MSG_DONTWAIT,
+	              (const struct sockaddr *)&addr, sizeof(addr)) == (ssize_t)stream.Size();
+}
+
+//--------------------------------------------------------------
+void ControlReceiver::run() {
+	std::unique_ptr<char[]> buffer(new char[maxPacketSize]);
+	while(running.load(std::memory_order_relaxed)) {
+		struct pollfd fd = {socket, POLLIN, 0};
+		if(poll(&fd, 1, pollInterval) <= 0) {continue;}
+
+		struct sockaddr_in from;
+		struct iovec iov = {buffer.get(), maxPacketSize};
+		alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(struct timeval))];
+		struct msghdr header;
+		std::memset(&header, 0, sizeof(header));
+		header.msg_name = &from;
+		header.msg_namelen = sizeof(from);
+		header.msg_iov = &iov;
+		header.msg_iovlen = 1;
+		header.msg_control = control;
+		header.msg_controllen = sizeof(control);
+		ssize_t size = recvmsg(socket, &header, 0);
+		if(size <= 0) {continue;}
+
+		// kernel receive time, if available
+		auto arrived = std::chrono::system_clock::now();
+		for(struct cmsghdr *c = CMSG_FIRSTHDR(&header); c; c = CMSG_NXTHDR(&header, c)) {
+			if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMP) {
+				struct timeval time;
+				std::memcpy(&time, CMSG_DATA(c), sizeof(time));
+				arrived = std::chrono::system_clock::time_point(
+					std::chrono::duration_cast<std::chrono::system_clock::duration>(
+					std::chrono::seconds(time.tv_sec) + std::chrono::microseconds(time.tv_usec)));
+			}
+		}
+
+		char host[INET_ADDRSTRLEN] = "";
+		inet_ntop(AF_INET, &from.sin_addr, host, sizeof(host));
+		try {
+			osc::ReceivedPacket packet(buffer.get(), (osc::osc_bundle_element_size_t)size);
+			process(packet, arrived, host, ntohs(from.sin_port));
+		}
+		catch(std::exception &e) {
+			malformed.fetch_add(1, std::memory_order_relaxed);
+			ofLogWarning(PACKAGE) << "control: malformed packet: " << e.what();
+		}
+	}
+}
+
+void ControlReceiver::process(const osc::ReceivedPacket & packet,
+                              std::chrono::system_clock::time_point arrived,
+                              const std::string & host, int port) {
+	if(packet.IsBundle()) {
+		osc::ReceivedBundle bundle(packet);
+		for(auto element = bundle.ElementsBegin(); element != bundle.ElementsEnd(); ++element) {
+			process(osc::ReceivedPacket(element->Contents(), element->Size()), arrived, host, port);
+		}
+		return;
+	}
+
+	// convert args as ofxOscReceiver does, blobs are not used for control
+	osc::ReceivedMessage incoming(packet);
+	ofxOscMessage message;
+	message.setAddress(incoming.AddressPattern());
+	message.setRemoteEndpoint(host, port);
+	for(auto arg = incoming.ArgumentsBegin(); arg != incoming.ArgumentsEnd(); ++arg) {
+		if(arg->IsBool()) {message.addBoolArg(arg->AsBoolUnchecked());}
+		else if(arg->IsInt32()) {message.addIntArg(arg->AsInt32Unchecked());}
+		else if(arg->IsInt64()) {message.addInt64Arg(arg->AsInt64Unchecked());}
+		else if(arg->IsFloat()) {message.addFloatArg(arg->AsFloatUnchecked());}
+		else if(arg->IsDouble()) {message.addDoubleArg(arg->AsDoubleUnchecked());}
+		else if(arg->IsString()) {message.addStringArg(arg->AsStringUnchecked());}
+		else if(arg->IsSymbol()) {message.addSymbolArg(arg->AsSymbolUnchecked());}
+		else if(arg->IsNil()) {message.addNoneArg();}
+		else if(arg->IsInfinitum()) {message.addTriggerArg();}
+	}
+
+	// apply right away
+	if(handler) {handler(message);}
+	uint64_t latency = std::max((int64_t)0, (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now() - arrived).count());
+	received.fetch_add(1, std::memory_order_relaxed);
+	latencySum.fetch_add(latency, std::memory_order_relaxed);
+	if(latency > latencyMax.load(std::memory_order_relaxed)) {
+		latencyMax.store(latency, std::memory_order_relaxed);
+	}
+	ofLogVerbose(PACKAGE) << "control: " << message.getAddress() << " applied after " << latency << " us";
+
+	// then hand over to the main thread
+	std::lock_guard<std::mutex> lock(mutex);
+	if(messages.size() >= maxQueued) {
+		messages.pop_front();
+	}
+	messages.push_back(std::move(message));
+}
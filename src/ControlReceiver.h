@@ -0,0 +1,99 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ofxOsc.h"
+
+namespace osc {
+	class ReceivedPacket;
+}
+
+/// OSC control receiver with its own thread
+///
+/// each message is passed to a handler in the receiver thread as soon as it
+/// arrives, so control changes take effect right away instead of waiting for
+/// the next update(), and is then queued for the main thread which reads
+/// them with getNextMessage() like ofxOscReceiver
+///
+/// the time from the kernel receiving a packet to the handler returning is
+/// tracked as the control latency
+class ControlReceiver {
+
+	public:
+
+		/// message handler, called in the receiver thread
+		typedef std::function<void(const ofxOscMessage & message)> Handler;
+
+		ControlReceiver() {}
+		~ControlReceiver() {stop();}
+
+		// non-copyable
+		ControlReceiver(ControlReceiver const &) = delete;
+		ControlReceiver& operator=(const ControlReceiver &) = delete;
+
+		/// bind UDP port on all interfaces & start receiver thread,
+		/// at most maxQueued messages are kept for the main thread, dropping
+		/// the oldest, returns true on success
+		bool start(int port, Handler handler, std::size_t maxQueued=256);
+
+		/// stop receiver thread & close port
+		void stop();
+
+		/// get next queued message in the main thread,
+		/// returns false if there is none
+		bool getNextMessage(ofxOscMessage & message);
+
+		/// send messages as one bundle from the receiver port to a message's
+		/// remote host & port, ie. to reply to a request,
+		/// returns false if they could not be encoded or sent
+		bool reply(const ofxOscMessage & request, const std::vector<ofxOscMessage> & messages);
+
+		/// log message count & control latency
+		void logStats() const;
+
+		std::atomic<uint64_t> received{0};   //< messages handled
+		std::atomic<uint64_t> malformed{0};  //< packets which could not be parsed
+		std::atomic<uint64_t> latencySum{0}; //< receive to handled latency sum in us
+		std::atomic<uint64_t> latencyMax{0}; //< max receive to handled latency in us
+
+	private:
+
+		/// receiver thread loop
+		void run();
+
+		/// handle & queue messages in a packet or nested bundles
+		void process(const osc::ReceivedPacket & packet,
+		             std::chrono::system_clock::time_point arrived,
+		             const std::string & host, int port);
+
+		int socket = -1;
+		Handler handler;
+		std::size_t maxQueued = 256;
+		std::thread thread;
+		std::atomic<bool> running{false};
+		std::mutex mutex;
+		std::deque<ofxOscMessage> messages; //< queued for the main thread, guarded by mutex
+};
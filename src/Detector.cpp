@@ -0,0 +1,136 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#include "Detector.h"
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "ofMain.h"
+#include "config.h"
+
+// buffer sequence numbers wrap here so they stay exact as floats
+static const uint32_t sequenceWrap = 1 << 24;
+
+//--------------------------------------------------------------
+bool Detector::stress() {
+	const std::size_t bufferSize = 64;
+	const std::size_t numPrevious = 4;
+	const std::size_t numBuffers = 16;
+	const std::size_t numSlots = 3;
+	const auto duration = std::chrono::seconds(2);
+	Detector detector;
+	detector.setup(numPrevious, numBuffers, bufferSize, numSlots);
+
+	// audio thread: every sample of a buffer holds the buffer's sequence
+	// number, triggers come in pseudo random bursts
+	std::atomic<bool> running{true};
+	std::atomic<uint64_t> processed{0}, started{0}, completed{0};
+	std::thread audio([&]() {
+		SimpleAudioBuffer buffer(bufferSize);
+		uint32_t sequence = 0, random = 1;
+		uint64_t count = 0, starts = 0, completes = 0;
+		while(running.load(std::memory_order_relaxed)) {
+			std::fill(buffer.begin(), buffer.end(), (float)sequence);
+			random = random * 1664525 + 1013904223;
+			switch(detector.process(buffer, (random >> 24) < 96)) {
+				case STARTED: starts++; break;
+				case COMPLETED: completes++; break;
+				default: break;
+			}
+			sequence = (sequence + 1) % sequenceWrap;
+			count++;
+			if((random & 0x3f) == 0) {
+				std::this_thread::yield(); // interleave on a single core too
+			}
+		}
+		processed = count;
+		started = starts;
+		completed = completes;
+	});
+
+	// main thread: take clips & hold them for a while, checking each held
+	// clip is unchanged on every pass, then finish, with occasional disable
+	// & enable while clips are held
+	struct Held {
+		const ClipBuffer *clip = nullptr;
+		int slot = -1;
+		std::size_t age = 0;
+		std::vector<float> first;
+	};
+	std::vector<Held> held(numSlots - 1); // leave a slot to record into
+	for(auto & h : held) {h.first.resize(numBuffers);}
+	uint64_t taken = 0, disables = 0, dropped = 0;
+	uint64_t incomplete = 0, torn = 0, gaps = 0, changed = 0, busy = 0;
+	auto start = std::chrono::steady_clock::now();
+	for(uint64_t i = 0; std::chrono::steady_clock::now() - start < duration; i++) {
+		for(auto & h : held) {
+			if(h.clip) {
+				// the audio thread must leave a taken clip alone
+				for(std::size_t b = 0; b < h.clip->size(); b++) {
+					if(((const float *)h.clip->buffer(b))[0] != h.first[b]) {changed++; break;}
+				}
+				if(++h.age >= 8) {
+					detector.finish(h.slot);
+					h.clip = nullptr;
+				}
+				continue;
+			}
+			if(!detector.take(h.clip, h.slot)) {
+				h.clip = nullptr;
+				continue;
+			}
+			taken++;
+			h.age = 0;
+			if(!h.clip->isFull()) {incomplete++;}
+			for(std::size_t b = 0; b < h.clip->size(); b++) {
+				const float *samples = (const float *)h.clip->buffer(b);
+				h.first[b] = samples[0];
+				for(std::size_t s = 1; s < bufferSize; s++) {
+					if(samples[s] != samples[0]) {torn++; break;}
+				}
+			}
+
+			// the pre-roll & the recorded part must be consecutive buffers
+			for(std::size_t b = 1; b < h.clip->size(); b++) {
+				if((uint32_t)h.first[b] != ((uint32_t)h.first[b - 1] + 1) % sequenceWrap) {gaps++; break;}
+			}
+		}
+		if(detector.getNumBusy() > numSlots) {busy++;}
+		if(i % 500 == 499) {
+			if(detector.disable()) {dropped++;}
+			disables++;
+			detector.enable();
+		}
+		std::this_thread::yield();
+	}
+	for(auto & h : held) {
+		if(h.clip) {detector.finish(h.slot);}
+	}
+	running = false;
+	audio.join();
+
+	std::cout << "detector: " << processed << " buffers, " << started << " started, "
+	          << detector.missed << " missed, " << completed << " completed, " << taken << " taken, "
+	          << disables << " disables (" << dropped << " dropping a clip)" << std::endl;
+	std::cout << "detector: " << incomplete << " incomplete, " << torn << " torn, "
+	          << gaps << " with gaps, " << changed << " changed while taken, "
+	          << busy << " over busy" << std::endl;
+	bool ok = (taken > 0 && incomplete == 0 && torn == 0 && gaps == 0 && changed == 0 && busy == 0);
+	std::cout << "detector: " << (ok ? "ok" : "FAILED") << std::endl;
+	return ok;
+}
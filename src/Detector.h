@@ -0,0 +1,271 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "AudioClassifier.h"
+#include "ClipTiming.h"
+
+/// detector recording state machine shared by the audio & main threads
+///
+/// clips are recorded into a fixed number of slots, so a new recording can
+/// start while previous clips are still waiting for or running inference,
+/// each slot moves through:
+///
+///   free -> recording: process() volume trigger       (audio)
+///   recording -> pending: process() clip complete     (audio)
+///   pending -> inferring: take() clip                 (main)
+///   inferring -> free: finish() inference             (main)
+///   recording/pending -> free: disable()              (main)
+///
+/// transitions are atomic compare & swaps, so a transition fails if the other
+/// thread changed the state in the meantime, ie. disable() while recording
+///
+/// the audio thread owns the previous buffers & recording slot buffers, a
+/// taken clip is read in place until finish() while the audio thread leaves
+/// it alone, all buffers are preallocated in setup() so recording makes no
+/// allocations
+class Detector {
+
+	public:
+
+		/// slot states
+		enum State {
+			FREE,      //< available for recording
+			RECORDING, //< recording clip
+			PENDING,   //< clip complete, waiting for inference
+			INFERRING  //< clip taken for inference
+		};
+
+		/// process() events
+		enum Event {
+			NONE,     //< nothing happened
+			STARTED,  //< recording started
+			COMPLETED //< recording complete, clip pending
+		};
+
+		/// set number of previous buffers to keep, total clip length in buffers,
+		/// samples per buffer, number of clip slots which can be in flight at
+		/// once, and the stored sample format, call before audio starts
+		void setup(const std::size_t numPreviousBuffers, const std::size_t numBuffers,
+		           const std::size_t bufferSize, const std::size_t numSlots=2,
+		           const CaptureFormat & format=CaptureFormat()) {
+			previousBuffers.setup(numPreviousBuffers, bufferSize, format);
+			this->numSlots = std::max(numSlots, (std::size_t)1);
+			slots.reset(new Slot[this->numSlots]);
+			for(std::size_t i = 0; i < this->numSlots; i++) {
+				slots[i].buffers.setup(numBuffers, bufferSize, format);
+			}
+		}
+
+		/// process incoming mono buffer of bufferSize samples in the audio thread,
+		/// trigger starts a recording when listening and a slot is free, a new
+		/// clip begins with the previous buffers followed by the trigger buffer,
+		/// the previous buffers are kept current while recording so back to
+		/// back clips get fresh pre-roll
+		/// returns event if a recording started or completed
+		Event process(const SimpleAudioBuffer & buffer, bool trigger) {
+			if(reset.exchange(false, std::memory_order_acquire)) {
+				previousBuffers.clear();
+			}
+			Event event = NONE;
+
+			// if recording: save the incoming buffer to the recording,
+			// then hand it over for inference once complete
+			if(recordingSlot >= 0) {
+				Slot & slot = slots[recordingSlot];
+				int expected = slot.state.load(std::memory_order_acquire);
+				if(expected == RECORDING) {
+					slot.buffers.push(buffer.data());
+					if(slot.buffers.isFull()) {
+						recordingSlot = -1;
+						slot.recorded = std::chrono::steady_clock::now();
+						if(slot.state.compare_exchange_strong(expected, PENDING, std::memory_order_acq_rel)) {
+							event = COMPLETED;
+						}
+					}
+				}
+				else {
+					recordingSlot = -1; // dropped by disable()
+				}
+			}
+
+			// start recording into a free slot? a trigger which finds all slots
+			// busy is counted once until the volume drops or a recording starts
+			if(recordingSlot < 0 && event == NONE) {
+				if(trigger && enabled.load(std::memory_order_acquire)) {
+					for(std::size_t i = 0; i < numSlots; i++) {
+						int expected = FREE;
+						if(slots[i].state.compare_exchange_strong(expected, RECORDING, std::memory_order_acq_rel)) {
+							// copy previous buffers to the recording, we already have the previous buffers
+							slots[i].buffers.clear();
+							previousBuffers.copyTo(slots[i].buffers);
+							slots[i].buffers.push(buffer.data());
+							recordingSlot = (int)i;
+							slots[i].triggered = std::chrono::steady_clock::now();
+							slots[i].recorded = ClipTiming::Time();
+							triggers.store(triggers.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+							started.store(true, std::memory_order_release);
+							event = STARTED;
+							break;
+						}
+					}
+					if(recordingSlot < 0 && !refused) {
+						missed.store(missed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+					}
+					refused = (recordingSlot < 0);
+				}
+				else {
+					refused = false;
+				}
+			}
+
+			// save the incoming buffer to the previous buffer fifo
+			previousBuffers.push(buffer.data());
+			return event;
+		}
+
+		/// take a pending clip for inference in the main thread, sets clip which
+		/// stays valid until finish() and slot index to pass to finish() later,
+		/// returns true if a clip was taken
+		bool take(const ClipBuffer *& clip, int & slot) {
+			for(std::size_t i = 0; i < numSlots; i++) {
+				int expected = PENDING;
+				if(slots[i].state.compare_exchange_strong(expected, INFERRING, std::memory_order_acq_rel)) {
+					clip = &slots[i].buffers;
+					slot = (int)i;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		/// set recording timestamps of a taken clip in the main thread
+		void getTiming(int slot, ClipTiming & timing) const {
+			if(slot < 0 || slot >= (int)numSlots) {return;}
+			timing.triggered = slots[slot].triggered;
+			timing.recorded = slots[slot].recorded;
+		}
+
+		/// inference finished for a taken clip in the main thread, frees slot
+		void finish(int slot) {
+			if(slot < 0 || slot >= (int)numSlots) {return;}
+			int expected = INFERRING;
+			slots[slot].state.compare_exchange_strong(expected, FREE, std::memory_order_acq_rel);
+		}
+
+		/// start listening, previous buffers are cleared in the audio thread
+		void enable() {
+			reset.store(true, std::memory_order_release);
+			enabled.store(true, std::memory_order_release);
+		}
+
+		/// stop listening, drops any recording or pending clip,
+		/// returns true if a recording or pending clip was dropped
+		bool disable() {
+			enabled.store(false, std::memory_order_release);
+			bool dropped = false;
+			for(std::size_t i = 0; i < numSlots; i++) {
+				for(int state : {RECORDING, PENDING}) {
+					int expected = state;
+					if(slots[i].state.compare_exchange_strong(expected, FREE, std::memory_order_acq_rel)) {
+						dropped = true;
+					}
+				}
+			}
+			return dropped;
+		}
+
+		/// returns true once after a recording started
+		bool takeStarted() {
+			return started.exchange(false, std::memory_order_acquire);
+		}
+
+		/// returns true if a clip is being recorded
+		bool isRecording() const {
+			return countSlots(RECORDING) > 0;
+		}
+
+		/// returns number of clips recording, pending, or inferring
+		std::size_t getNumBusy() const {
+			return numSlots - countSlots(FREE);
+		}
+
+		/// returns number of clip slots
+		std::size_t getNumSlots() const {return numSlots;}
+
+		/// returns previous & slot buffer bytes
+		std::size_t getMemorySize() const {
+			std::size_t bytes = previousBuffers.getMemorySize();
+			for(std::size_t i = 0; i < numSlots; i++) {
+				bytes += slots[i].buffers.getMemorySize();
+			}
+			return bytes;
+		}
+
+		std::atomic<uint64_t> triggers{0}; //< recordings started, written by the audio thread
+		std::atomic<uint64_t> missed{0};   //< triggers refused with all slots busy, written by the audio thread
+
+		/// hammer process(), take(), finish(), & disable() from an audio & a
+		/// main thread for a few seconds, checking that taken clips are
+		/// complete, consecutive, & not written while taken, build with
+		/// -fsanitize=thread to also check for races,
+		/// returns true if no errors were found
+		static bool stress();
+
+		/// lock previous & slot buffer memory into RAM, call after setup()
+		void lock(MemoryLock & memory) const {
+			previousBuffers.lock(memory);
+			for(std::size_t i = 0; i < numSlots; i++) {
+				slots[i].buffers.lock(memory);
+			}
+		}
+
+	private:
+
+		/// clip recording slot
+		struct Slot {
+			std::atomic<int> state{FREE};
+			ClipBuffer buffers;
+			ClipTiming::Time triggered; //< recording started, written by the audio thread
+			ClipTiming::Time recorded;  //< recording complete, written by the audio thread
+		};
+
+		std::size_t countSlots(State state) const {
+			std::size_t count = 0;
+			for(std::size_t i = 0; i < numSlots; i++) {
+				if(slots[i].state.load(std::memory_order_acquire) == state) {
+					count++;
+				}
+			}
+			return count;
+		}
+
+		std::atomic<bool> enabled{true};  //< listening?
+		std::atomic<bool> started{false}; //< recording started event
+		std::atomic<bool> reset{false};   //< clear previous buffers request
+
+		// since volume detection has some latency, we keep a history of buffers
+		BufferRing previousBuffers;
+		std::unique_ptr<Slot[]> slots;
+		std::size_t numSlots = 0;
+
+		// audio thread only
+		int recordingSlot = -1;
+		bool refused = false; //< last trigger found no free slot
+};
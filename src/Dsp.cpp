@@ -0,0 +1,841 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#include "Dsp.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+	#define DSP_X86
+	#include <immintrin.h>
+	#define DSP_AVX2 __attribute__((target("avx2,fma")))
+	#define DSP_AVX512 __attribute__((target("avx512f")))
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+	#define DSP_INLINE inline __attribute__((always_inline))
+#else
+	#define DSP_INLINE inline
+#endif
+
+//--------------------------------------------------------------
+// reference: the original scalar loops
+
+static float referenceDeinterleaveSumSquares(const float *in, std::size_t frames,
+                                             std::size_t channels, std::size_t channel, float *out) {
+	for(std::size_t i = 0; i < frames; i++) {
+		out[i] = in[(i*channels)+channel];
+	}
+	float sumVol = 0.0;
+	for(std::size_t i = 0; i < frames; i++) {
+		float vol = out[i];
+		sumVol += vol * vol;
+	}
+	return sumVol;
+}
+
+static void referenceDecimate(const float *in, std::size_t outLength, std::size_t factor, float *out) {
+	for(std::size_t j = 0; j < outLength; j++) {
+		std::size_t offset = j * factor;
+		float sum = 0.0;
+		for(std::size_t k = 0; k < factor; k++) {
+			sum += in[offset+k];
+		}
+		out[j] = sum / factor;
+	}
+}
+
+static void referenceDecimateInt16(const int16_t *in, std::size_t outLength, std::size_t factor,
+                                   float scale, float *out) {
+	for(std::size_t j = 0; j < outLength; j++) {
+		std::size_t offset = j * factor;
+		int32_t sum = 0;
+		for(std::size_t k = 0; k < factor; k++) {
+			sum += in[offset+k];
+		}
+		out[j] = sum * scale;
+	}
+}
+
+static float referenceNormalize(float *data, std::size_t length) {
+	// find absolute maximum value
+	float max = 0.0;
+	for(std::size_t i = 0; i < length; i++) {
+		if(std::abs(data[i]) > max) {
+			max = std::abs(data[i]);
+		}
+	}
+	if(max == 0.0) {
+		return max;
+	}
+	for(std::size_t i = 0; i < length; i++) {
+		data[i] /= max;
+	}
+	return max;
+}
+
+static void referenceFloatToInt16(const float *in, std::size_t length, float scale, int16_t *out) {
+	for(std::size_t i = 0; i < length; i++) {
+		out[i] = (int16_t)std::max(-32767.0f, std::min(32767.0f, in[i] * scale));
+	}
+}
+
+static const DspKernels referenceKernels = {
+	"reference",
+	referenceDeinterleaveSumSquares,
+	referenceDecimate,
+	referenceDecimateInt16,
+	referenceNormalize,
+	referenceFloatToInt16
+};
+
+//--------------------------------------------------------------
+// decimation, specialized by factor at compile time, used by the scalar
+// kernels & for the tails & other factors of the vector kernels, which
+// gather the strided samples with explicit shuffles as auto-vectorized
+// strided loops were no faster than scalar for factor 3
+
+template<std::size_t F>
+DSP_INLINE void decimateFixed(const float *in, std::size_t outLength, float *out) {
+	const float gain = 1.0f / F;
+	for(std::size_t j = 0; j < outLength; j++) {
+		float sum = 0;
+		for(std::size_t k = 0; k < F; k++) {
+			sum += in[j*F+k];
+		}
+		out[j] = sum * gain;
+	}
+}
+
+DSP_INLINE void decimateAny(const float *in, std::size_t outLength, std::size_t factor, float *out) {
+	switch(factor) {
+		case 1: std::memcpy(out, in, outLength * sizeof(float)); break;
+		case 2: decimateFixed<2>(in, outLength, out); break;
+		case 3: decimateFixed<3>(in, outLength, out); break;
+		case 6: decimateFixed<6>(in, outLength, out); break;
+		default: referenceDecimate(in, outLength, factor, out); break;
+	}
+}
+
+template<std::size_t F>
+DSP_INLINE void decimateInt16Fixed(const int16_t *in, std::size_t outLength, float scale, float *out) {
+	for(std::size_t j = 0; j < outLength; j++) {
+		int32_t sum = 0;
+		for(std::size_t k = 0; k < F; k++) {
+			sum += in[j*F+k];
+		}
+		out[j] = sum * scale;
+	}
+}
+
+DSP_INLINE void decimateInt16Any(const int16_t *in, std::size_t outLength, std::size_t factor,
+                                 float scale, float *out) {
+	switch(factor) {
+		case 1: decimateInt16Fixed<1>(in, outLength, scale, out); break;
+		case 2: decimateInt16Fixed<2>(in, outLength, scale, out); break;
+		case 3: decimateInt16Fixed<3>(in, outLength, scale, out); break;
+		case 6: decimateInt16Fixed<6>(in, outLength, scale, out); break;
+		default: referenceDecimateInt16(in, outLength, factor, scale, out); break;
+	}
+}
+
+//--------------------------------------------------------------
+// scalar: specialized decimation, single pass loops
+
+static float scalarDeinterleaveSumSquares(const float *in, std::size_t frames,
+                                          std::size_t channels, std::size_t channel, float *out) {
+	float sum = 0;
+	for(std::size_t i = 0; i < frames; i++) {
+		float v = in[i*channels+channel];
+		out[i] = v;
+		sum += v * v;
+	}
+	return sum;
+}
+
+static void scalarDecimate(const float *in, std::size_t outLength, std::size_t factor, float *out) {
+	decimateAny(in, outLength, factor, out);
+}
+
+static void scalarDecimateInt16(const int16_t *in, std::size_t outLength, std::size_t factor,
+                                float scale, float *out) {
+	decimateInt16Any(in, outLength, factor, scale, out);
+}
+
+static float scalarNormalize(float *data, std::size_t length) {
+	float max = 0;
+	for(std::size_t i = 0; i < length; i++) {
+		max = std::max(max, std::abs(data[i]));
+	}
+	if(max == 0) {
+		return max;
+	}
+	const float gain = 1.0f / max;
+	for(std::size_t i = 0; i < length; i++) {
+		data[i] *= gain;
+	}
+	return max;
+}
+
+static const DspKernels scalarKernels = {
+	"scalar",
+	scalarDeinterleaveSumSquares,
+	scalarDecimate,
+	scalarDecimateInt16,
+	scalarNormalize,
+	referenceFloatToInt16
+};
+
+#ifdef DSP_X86
+
+//--------------------------------------------------------------
+// SSE2, x86 baseline
+
+static inline float sseSum(__m128 v) {
+	v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+	v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+	return _mm_cvtss_f32(v);
+}
+
+static inline float sseMax(__m128 v) {
+	v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+	v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+	return _mm_cvtss_f32(v);
+}
+
+static float sseDeinterleaveSumSquares(const float *in, std::size_t frames,
+                                       std::size_t channels, std::size_t channel, float *out) {
+	__m128 acc = _mm_setzero_ps();
+	std::size_t i = 0;
+	for(; i + 4 <= frames; i += 4) {
+		__m128 v;
+		if(channels == 1) {
+			v = _mm_loadu_ps(in + i);
+		}
+		else if(channels == 2) {
+			__m128 a = _mm_loadu_ps(in + i*2), b = _mm_loadu_ps(in + i*2 + 4);
+			v = (channel == 0 ? _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))
+			                  : _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+		else {
+			v = _mm_setr_ps(in[i*channels+channel], in[(i+1)*channels+channel],
+			                in[(i+2)*channels+channel], in[(i+3)*channels+channel]);
+		}
+		_mm_storeu_ps(out + i, v);
+		acc = _mm_add_ps(acc, _mm_mul_ps(v, v));
+	}
+	float sum = sseSum(acc);
+	for(; i < frames; i++) {
+		float v = in[i*channels+channel];
+		out[i] = v;
+		sum += v * v;
+	}
+	return sum;
+}
+
+// 4 samples as floats
+static inline __m128 sseLoad(const float *in) {
+	return _mm_loadu_ps(in);
+}
+
+static inline __m128 sseLoad(const int16_t *in) {
+	__m128i v = _mm_loadl_epi64((const __m128i *)in);
+	return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
+
+// sums of each 2 consecutive samples of a, b
+static inline __m128 sseSum2(__m128 a, __m128 b) {
+	return _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+	                  _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+// sums of each 3 consecutive samples of a, b, c: gather samples 0, 1, & 2
+// of each triple into their own vector, picking pairs then interleaving
+static inline __m128 sseSum3(__m128 a, __m128 b, __m128 c) {
+	__m128 x0 = _mm_shuffle_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 0, 0)),
+	                           _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+	__m128 x1 = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),
+	                           _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+	__m128 x2 = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),
+	                           _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+	return _mm_add_ps(_mm_add_ps(x0, x1), x2);
+}
+
+// decimate by F of 1, 2, 3, or 6 times gain, 4 outputs at a time,
+// returns the number of outputs written
+template<std::size_t F, typename T>
+static std::size_t sseDecimateFixed(const T *in, std::size_t outLength, float gain, float *out) {
+	const __m128 g = _mm_set1_ps(gain);
+	std::size_t j = 0;
+	for(; j + 4 <= outLength; j += 4) {
+		const T *p = in + j*F;
+		__m128 sum;
+		if(F == 1) {
+			sum = sseLoad(p);
+		}
+		else if(F == 2) {
+			sum = sseSum2(sseLoad(p), sseLoad(p + 4));
+		}
+		else if(F == 3) {
+			sum = sseSum3(sseLoad(p), sseLoad(p + 4), sseLoad(p + 8));
+		}
+		else {
+			sum = sseSum3(sseSum2(sseLoad(p), sseLoad(p + 4)), sseSum2(sseLoad(p + 8), sseLoad(p + 12)),
+			              sseSum2(sseLoad(p + 16), sseLoad(p + 20)));
+		}
+		_mm_storeu_ps(out + j, _mm_mul_ps(sum, g));
+	}
+	return j;
+}
+
+static void sseDecimate(const float *in, std::size_t outLength, std::size_t factor, float *out) {
+	std::size_t j = 0;
+	switch(factor) {
+		case 2: j = sseDecimateFixed<2>(in, outLength, 1.0f / 2, out); break;
+		case 3: j = sseDecimateFixed<3>(in, outLength, 1.0f / 3, out); break;
+		case 6: j = sseDecimateFixed<6>(in, outLength, 1.0f / 6, out); break;
+		default: break;
+	}
+	decimateAny(in + j*factor, outLength - j, factor, out + j);
+}
+
+static void sseDecimateInt16(const int16_t *in, std::size_t outLength, std::size_t factor,
+                             float scale, float *out) {
+	std::size_t j = 0;
+	switch(factor) {
+		case 1: j = sseDecimateFixed<1>(in, outLength, scale, out); break;
+		case 2: j = sseDecimateFixed<2>(in, outLength, scale, out); break;
+		case 3: j = sseDecimateFixed<3>(in, outLength, scale, out); break;
+		case 6: j = sseDecimateFixed<6>(in, outLength, scale, out); break;
+		default: break;
+	}
+	decimateInt16Any(in + j*factor, outLength - j, factor, scale, out + j);
+}
+
+static float sseNormalize(float *data, std::size_t length) {
+	const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 acc = _mm_setzero_ps();
+	std::size_t i = 0;
+	for(; i + 4 <= length; i += 4) {
+		acc = _mm_max_ps(acc, _mm_and_ps(_mm_loadu_ps(data + i), mask));
+	}
+	float max = sseMax(acc);
+	for(; i < length; i++) {
+		max = std::max(max, std::abs(data[i]));
+	}
+	if(max == 0) {
+		return max;
+	}
+	const __m128 gain = _mm_set1_ps(1.0f / max);
+	for(i = 0; i + 4 <= length; i += 4) {
+		_mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), gain));
+	}
+	for(; i < length; i++) {
+		data[i] *= 1.0f / max;
+	}
+	return max;
+}
+
+static void sseFloatToInt16(const float *in, std::size_t length, float scale, int16_t *out) {
+	const __m128 gain = _mm_set1_ps(scale);
+	const __m128 lo = _mm_set1_ps(-32767.0f), hi = _mm_set1_ps(32767.0f);
+	std::size_t i = 0;
+	for(; i + 8 <= length; i += 8) {
+		__m128 a = _mm_min_ps(hi, _mm_max_ps(lo, _mm_mul_ps(_mm_loadu_ps(in + i), gain)));
+		__m128 b = _mm_min_ps(hi, _mm_max_ps(lo, _mm_mul_ps(_mm_loadu_ps(in + i + 4), gain)));
+		__m128i packed = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+		_mm_storeu_si128((__m128i *)(out + i), packed);
+	}
+	referenceFloatToInt16(in + i, length - i, scale, out + i);
+}
+
+static const DspKernels sseKernels = {
+	"sse2",
+	sseDeinterleaveSumSquares,
+	sseDecimate,
+	sseDecimateInt16,
+	sseNormalize,
+	sseFloatToInt16
+};
+
+//--------------------------------------------------------------
+// AVX2
+
+DSP_AVX2 static inline float avx2Sum(__m256 v) {
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+	return _mm_cvtss_f32(s);
+}
+
+DSP_AVX2 static inline float avx2Max(__m256 v) {
+	__m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+	return _mm_cvtss_f32(m);
+}
+
+DSP_AVX2 static float avx2DeinterleaveSumSquares(const float *in, std::size_t frames,
+                                                 std::size_t channels, std::size_t channel, float *out) {
+	__m256 acc = _mm256_setzero_ps();
+	const __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+	                                         _mm256_set1_epi32((int)channels));
+	std::size_t i = 0;
+	for(; i + 8 <= frames; i += 8) {
+		__m256 v = (channels == 1 ? _mm256_loadu_ps(in + i)
+		                          : _mm256_i32gather_ps(in + i*channels + channel, index, 4));
+		_mm256_storeu_ps(out + i, v);
+		acc = _mm256_fmadd_ps(v, v, acc);
+	}
+	float sum = avx2Sum(acc);
+	for(; i < frames; i++) {
+		float v = in[i*channels+channel];
+		out[i] = v;
+		sum += v * v;
+	}
+	return sum;
+}
+
+// 8 samples as floats
+DSP_AVX2 static inline __m256 avx2Load(const float *in) {
+	return _mm256_loadu_ps(in);
+}
+
+DSP_AVX2 static inline __m256 avx2Load(const int16_t *in) {
+	return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)in)));
+}
+
+// sums of each 2 consecutive samples of a, b, shuffles work per 128 bit
+// lane so restore order after
+DSP_AVX2 static inline __m256 avx2Sum2(__m256 a, __m256 b) {
+	__m256 sum = _mm256_add_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+	                           _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+	return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sum), _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+// sums of each 3 consecutive samples of a, b, c: samples 0, 1, & 2 of the
+// 8 triples each fall in distinct lanes, so blend them into one vector per
+// sample & permute into triple order
+DSP_AVX2 static inline __m256 avx2Sum3(__m256 a, __m256 b, __m256 c) {
+	const __m256i order0 = _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5);
+	const __m256i order1 = _mm256_setr_epi32(1, 4, 7, 2, 5, 0, 3, 6);
+	const __m256i order2 = _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7);
+	__m256 x0 = _mm256_blend_ps(_mm256_blend_ps(a, b, 0x92), c, 0x24);
+	__m256 x1 = _mm256_blend_ps(_mm256_blend_ps(a, b, 0x24), c, 0x49);
+	__m256 x2 = _mm256_blend_ps(_mm256_blend_ps(a, b, 0x49), c, 0x92);
+	return _mm256_add_ps(_mm256_add_ps(_mm256_permutevar8x32_ps(x0, order0),
+	                                   _mm256_permutevar8x32_ps(x1, order1)),
+	                     _mm256_permutevar8x32_ps(x2, order2));
+}
+
+// decimate by F of 1, 2, 3, or 6 times gain, 8 outputs at a time,
+// returns the number of outputs written
+template<std::size_t F, typename T>
+DSP_AVX2 static std::size_t avx2DecimateFixed(const T *in, std::size_t outLength, float gain, float *out) {
+	const __m256 g = _mm256_set1_ps(gain);
+	std::size_t j = 0;
+	for(; j + 8 <= outLength; j += 8) {
+		const T *p = in + j*F;
+		__m256 sum;
+		if(F == 1) {
+			sum = avx2Load(p);
+		}
+		else if(F == 2) {
+			sum = avx2Sum2(avx2Load(p), avx2Load(p + 8));
+		}
+		else if(F == 3) {
+			sum = avx2Sum3(avx2Load(p), avx2Load(p + 8), avx2Load(p + 16));
+		}
+		else {
+			sum = avx2Sum3(avx2Sum2(avx2Load(p), avx2Load(p + 8)), avx2Sum2(avx2Load(p + 16), avx2Load(p + 24)),
+			               avx2Sum2(avx2Load(p + 32), avx2Load(p + 40)));
+		}
+		_mm256_storeu_ps(out + j, _mm256_mul_ps(sum, g));
+	}
+	return j;
+}
+
+DSP_AVX2 static void avx2Decimate(const float *in, std::size_t outLength, std::size_t factor, float *out) {
+	std::size_t j = 0;
+	switch(factor) {
+		case 2: j = avx2DecimateFixed<2>(in, outLength, 1.0f / 2, out); break;
+		case 3: j = avx2DecimateFixed<3>(in, outLength, 1.0f / 3, out); break;
+		case 6: j = avx2DecimateFixed<6>(in, outLength, 1.0f / 6, out); break;
+		default: break;
+	}
+	decimateAny(in + j*factor, outLength - j, factor, out + j);
+}
+
+DSP_AVX2 static void avx2DecimateInt16(const int16_t *in, std::size_t outLength, std::size_t factor,
+                                       float scale, float *out) {
+	std::size_t j = 0;
+	switch(factor) {
+		case 1: j = avx2DecimateFixed<1>(in, outLength, scale, out); break;
+		case 2: j = avx2DecimateFixed<2>(in, outLength, scale, out); break;
+		case 3: j = avx2DecimateFixed<3>(in, outLength, scale, out); break;
+		case 6: j = avx2DecimateFixed<6>(in, outLength, scale, out); break;
+		default: break;
+	}
+	decimateInt16Any(in + j*factor, outLength - j, factor, scale, out + j);
+}
+
+DSP_AVX2 static float avx2Normalize(float *data, std::size_t length) {
+	const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	__m256 acc = _mm256_setzero_ps();
+	std::size_t i = 0;
+	for(; i + 8 <= length; i += 8) {
+		acc = _mm256_max_ps(acc, _mm256_and_ps(_mm256_loadu_ps(data + i), mask));
+	}
+	float max = avx2Max(acc);
+	for(; i < length; i++) {
+		max = std::max(max, std::abs(data[i]));
+	}
+	if(max == 0) {
+		return max;
+	}
+	const __m256 gain = _mm256_set1_ps(1.0f / max);
+	for(i = 0; i + 8 <= length; i += 8) {
+		_mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), gain));
+	}
+	for(; i < length; i++) {
+		data[i] *= 1.0f / max;
+	}
+	return max;
+}
+
+DSP_AVX2 static void avx2FloatToInt16(const float *in, std::size_t length, float scale, int16_t *out) {
+	const __m256 gain = _mm256_set1_ps(scale);
+	const __m256 lo = _mm256_set1_ps(-32767.0f), hi = _mm256_set1_ps(32767.0f);
+	std::size_t i = 0;
+	for(; i + 16 <= length; i += 16) {
+		__m256 a = _mm256_min_ps(hi, _mm256_max_ps(lo, _mm256_mul_ps(_mm256_loadu_ps(in + i), gain)));
+		__m256 b = _mm256_min_ps(hi, _mm256_max_ps(lo, _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), gain)));
+		// packs works per 128 bit lane, restore order after
+		__m256i packed = _mm256_packs_epi32(_mm256_cvttps_epi32(a), _mm256_cvttps_epi32(b));
+		packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i *)(out + i), packed);
+	}
+	referenceFloatToInt16(in + i, length - i, scale, out + i);
+}
+
+static const DspKernels avx2Kernels = {
+	"avx2",
+	avx2DeinterleaveSumSquares,
+	avx2Decimate,
+	avx2DecimateInt16,
+	avx2Normalize,
+	avx2FloatToInt16
+};
+
+//--------------------------------------------------------------
+// AVX-512
+
+DSP_AVX512 static float avx512DeinterleaveSumSquares(const float *in, std::size_t frames,
+                                                     std::size_t channels, std::size_t channel, float *out) {
+	__m512 acc = _mm512_setzero_ps();
+	const __m512i index = _mm512_mullo_epi32(
+		_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+		_mm512_set1_epi32((int)channels));
+	std::size_t i = 0;
+	for(; i + 16 <= frames; i += 16) {
+		__m512 v = (channels == 1 ? _mm512_loadu_ps(in + i)
+		                          : _mm512_i32gather_ps(index, in + i*channels + channel, 4));
+		_mm512_storeu_ps(out + i, v);
+		acc = _mm512_fmadd_ps(v, v, acc);
+	}
+	float sum = _mm512_reduce_add_ps(acc);
+	for(; i < frames; i++) {
+		float v = in[i*channels+channel];
+		out[i] = v;
+		sum += v * v;
+	}
+	return sum;
+}
+
+// 16 samples as floats
+DSP_AVX512 static inline __m512 avx512Load(const float *in) {
+	return _mm512_loadu_ps(in);
+}
+
+DSP_AVX512 static inline __m512 avx512Load(const int16_t *in) {
+	return _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i *)in)));
+}
+
+// indices 0, stride, 2 * stride... plus offset
+DSP_AVX512 static inline __m512i avx512Stride(int stride, int offset) {
+	return _mm512_add_epi32(_mm512_mullo_epi32(
+		_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+		_mm512_set1_epi32(stride)), _mm512_set1_epi32(offset));
+}
+
+// sums of each 2 consecutive samples of a, b
+DSP_AVX512 static inline __m512 avx512Sum2(__m512 a, __m512 b) {
+	return _mm512_add_ps(_mm512_permutex2var_ps(a, avx512Stride(2, 0), b),
+	                     _mm512_permutex2var_ps(a, avx512Stride(2, 1), b));
+}
+
+// sums of each 3 consecutive samples of a, b, c: gather samples 0, 1, & 2
+// of each triple from a & b, then the remaining lanes from c, the permutes
+// only use the low index bits so the same indices work for both
+DSP_AVX512 static inline __m512 avx512Sum3(__m512 a, __m512 b, __m512 c) {
+	const __m512i index0 = avx512Stride(3, 0), index1 = avx512Stride(3, 1), index2 = avx512Stride(3, 2);
+	__m512 x0 = _mm512_mask_permutexvar_ps(_mm512_permutex2var_ps(a, index0, b), 0xF800, index0, c);
+	__m512 x1 = _mm512_mask_permutexvar_ps(_mm512_permutex2var_ps(a, index1, b), 0xF800, index1, c);
+	__m512 x2 = _mm512_mask_permutexvar_ps(_mm512_permutex2var_ps(a, index2, b), 0xFC00, index2, c);
+	return _mm512_add_ps(_mm512_add_ps(x0, x1), x2);
+}
+
+// decimate by F of 1, 2, 3, or 6 times gain, 16 outputs at a time,
+// returns the number of outputs written
+template<std::size_t F, typename T>
+DSP_AVX512 static std::size_t avx512DecimateFixed(const T *in, std::size_t outLength, float gain, float *out) {
+	const __m512 g = _mm512_set1_ps(gain);
+	std::size_t j = 0;
+	for(; j + 16 <= outLength; j += 16) {
+		const T *p = in + j*F;
+		__m512 sum;
+		if(F == 1) {
+			sum = avx512Load(p);
+		}
+		else if(F == 2) {
+			sum = avx512Sum2(avx512Load(p), avx512Load(p + 16));
+		}
+		else if(F == 3) {
+			sum = avx512Sum3(avx512Load(p), avx512Load(p + 16), avx512Load(p + 32));
+		}
+		else {
+			sum = avx512Sum3(avx512Sum2(avx512Load(p), avx512Load(p + 16)),
+			                 avx512Sum2(avx512Load(p + 32), avx512Load(p + 48)),
+			                 avx512Sum2(avx512Load(p + 64), avx512Load(p + 80)));
+		}
+		_mm512_storeu_ps(out + j, _mm512_mul_ps(sum, g));
+	}
+	return j;
+}
+
+DSP_AVX512 static void avx512Decimate(const float *in, std::size_t outLength, std::size_t factor, float *out) {
+	std::size_t j = 0;
+	switch(factor) {
+		case 2: j = avx512DecimateFixed<2>(in, outLength, 1.0f / 2, out); break;
+		case 3: j = avx512DecimateFixed<3>(in, outLength, 1.0f / 3, out); break;
+		case 6: j = avx512DecimateFixed<6>(in, outLength, 1.0f / 6, out); break;
+		default: break;
+	}
+	decimateAny(in + j*factor, outLength - j, factor, out + j);
+}
+
+DSP_AVX512 static void avx512DecimateInt16(const int16_t *in, std::size_t outLength, std::size_t factor,
+                                           float scale, float *out) {
+	std::size_t j = 0;
+	switch(factor) {
+		case 1: j = avx512DecimateFixed<1>(in, outLength, scale, out); break;
+		case 2: j = avx512DecimateFixed<2>(in, outLength, scale, out); break;
+		case 3: j = avx512DecimateFixed<3>(in, outLength, scale, out); break;
+		case 6: j = avx512DecimateFixed<6>(in, outLength, scale, out); break;
+		default: break;
+	}
+	decimateInt16Any(in + j*factor, outLength - j, factor, scale, out + j);
+}
+
+DSP_AVX512 static float avx512Normalize(float *data, std::size_t length) {
+	__m512 acc = _mm512_setzero_ps();
+	std::size_t i = 0;
+	for(; i + 16 <= length; i += 16) {
+		acc = _mm512_max_ps(acc, _mm512_abs_ps(_mm512_loadu_ps(data + i)));
+	}
+	float max = _mm512_reduce_max_ps(acc);
+	for(; i < length; i++) {
+		max = std::max(max, std::abs(data[i]));
+	}
+	if(max == 0) {
+		return max;
+	}
+	const __m512 gain = _mm512_set1_ps(1.0f / max);
+	for(i = 0; i + 16 <= length; i += 16) {
+		_mm512_storeu_ps(data + i, _mm512_mul_ps(_mm512_loadu_ps(data + i), gain));
+	}
+	for(; i < length; i++) {
+		data[i] *= 1.0f / max;
+	}
+	return max;
+}
+
+DSP_AVX512 static void avx512FloatToInt16(const float *in, std::size_t length, float scale, int16_t *out) {
+	const __m512 gain = _mm512_set1_ps(scale);
+	const __m512 lo = _mm512_set1_ps(-32767.0f), hi = _mm512_set1_ps(32767.0f);
+	std::size_t i = 0;
+	for(; i + 16 <= length; i += 16) {
+		__m512 v = _mm512_min_ps(hi, _mm512_max_ps(lo, _mm512_mul_ps(_mm512_loadu_ps(in + i), gain)));
+		_mm256_storeu_si256((__m256i *)(out + i), _mm512_cvtsepi32_epi16(_mm512_cvttps_epi32(v)));
+	}
+	referenceFloatToInt16(in + i, length - i, scale, out + i);
+}
+
+static const DspKernels avx512Kernels = {
+	"avx512",
+	avx512DeinterleaveSumSquares,
+	avx512Decimate,
+	avx512DecimateInt16,
+	avx512Normalize,
+	avx512FloatToInt16
+};
+
+#endif // DSP_X86
+
+//--------------------------------------------------------------
+std::vector<const DspKernels*> dspSupported() {
+	std::vector<const DspKernels*> supported = {&scalarKernels};
+#ifdef DSP_X86
+	__builtin_cpu_init();
+	supported.push_back(&sseKernels);
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		supported.push_back(&avx2Kernels);
+	}
+	if(__builtin_cpu_supports("avx512f")) {
+		supported.push_back(&avx512Kernels);
+	}
+#endif
+	return supported;
+}
+
+// fastest supported kernels, without allocating as the first call may come
+// from the audio thread
+static const DspKernels * selectKernels() {
+#ifdef DSP_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx512f")) {
+		return &avx512Kernels;
+	}
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return &avx2Kernels;
+	}
+	return &sseKernels;
+#else
+	return &scalarKernels;
+#endif
+}
+
+const DspKernels & dsp() {
+	static const DspKernels *kernels = selectKernels();
+	return *kernels;
+}
+
+const DspKernels & dspReference() {
+	return referenceKernels;
+}
+
+//--------------------------------------------------------------
+
+// max abs difference between two arrays
+template<typename T>
+static float maxError(const std::vector<T> &a, const std::vector<T> &b) {
+	float error = 0;
+	for(std::size_t i = 0; i < a.size(); i++) {
+		error = std::max(error, (float)std::abs((float)a[i] - (float)b[i]));
+	}
+	return error;
+}
+
+// median run time of func in microseconds
+template<typename F>
+static float timeKernel(F func, std::size_t runs=200) {
+	std::vector<float> times;
+	for(std::size_t r = 0; r < runs; r++) {
+		auto start = std::chrono::steady_clock::now();
+		func();
+		times.push_back(std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count());
+	}
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+bool dspBenchmark() {
+	// typical sizes: 1024 frame input buffer & 5 s clip at 48 kHz
+	const std::size_t frames = 1024, clipLength = 240000;
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+	std::vector<float> interleaved(frames * 2), clip(clipLength);
+	std::vector<int16_t> clip16(clipLength);
+	for(auto &s : interleaved) {s = distribution(random) * 0.5f;}
+	for(auto &s : clip) {s = distribution(random) * 0.5f;}
+	referenceFloatToInt16(clip.data(), clip.size(), 32767.0f, clip16.data());
+
+	// allowed error, kernels may sum in a different order
+	const float tolerance = 1e-4f;
+	const DspKernels &ref = dspReference();
+	bool equivalent = true;
+	std::cout << "dsp kernels: " << dsp().name << " selected" << std::endl;
+	std::cout << std::left << std::setw(28) << "kernel" << std::setw(10) << "set"
+	          << std::setw(12) << "max error" << std::setw(10) << "us" << "speedup" << std::endl;
+	for(auto kernels : dspSupported()) {
+		auto report = [&](const std::string &name, float error, float refTime, float time) {
+			bool ok = (error <= tolerance);
+			equivalent = equivalent && ok;
+			std::cout << std::left << std::setw(28) << name << std::setw(10) << kernels->name
+			          << std::setw(12) << error << std::setw(10) << std::fixed << std::setprecision(1) << time
+			          << std::setprecision(2) << refTime / time << "x" << (ok ? "" : " MISMATCH")
+			          << std::defaultfloat << std::setprecision(6) << std::endl;
+		};
+
+		// de-interleave + sum of squares, stereo
+		for(std::size_t channels : {1, 2}) {
+			std::vector<float> refOut(frames), out(frames);
+			float refSum = 0, sum = 0;
+			float refTime = timeKernel([&]() {refSum = ref.deinterleaveSumSquares(interleaved.data(), frames, channels, channels - 1, refOut.data());});
+			float time = timeKernel([&]() {sum = kernels->deinterleaveSumSquares(interleaved.data(), frames, channels, channels - 1, out.data());});
+			report("deinterleave+rms " + std::to_string(channels) + "ch",
+			       std::max(maxError(refOut, out), std::abs(refSum - sum) / std::max(refSum, 1.0f)), refTime, time);
+		}
+
+		// decimation
+		for(std::size_t factor : {2, 3, 6}) {
+			std::vector<float> refOut(clipLength / factor), out(clipLength / factor);
+			float refTime = timeKernel([&]() {ref.decimate(clip.data(), refOut.size(), factor, refOut.data());});
+			float time = timeKernel([&]() {kernels->decimate(clip.data(), out.size(), factor, out.data());});
+			report("decimate x" + std::to_string(factor), maxError(refOut, out), refTime, time);
+		}
+		for(std::size_t factor : {1, 2, 3, 6}) {
+			const float scale = 1.0f / (32767.0f * factor);
+			std::vector<float> refOut(clipLength / factor), out(clipLength / factor);
+			float refTime = timeKernel([&]() {ref.decimateInt16(clip16.data(), refOut.size(), factor, scale, refOut.data());});
+			float time = timeKernel([&]() {kernels->decimateInt16(clip16.data(), out.size(), factor, scale, out.data());});
+			report("decimate int16 x" + std::to_string(factor), maxError(refOut, out), refTime, time);
+		}
+
+		// normalize, in place so time on copies
+		{
+			std::vector<float> refOut(clip), out(clip);
+			float refTime = timeKernel([&]() {std::copy(clip.begin(), clip.end(), refOut.begin()); ref.normalize(refOut.data(), refOut.size());});
+			float time = timeKernel([&]() {std::copy(clip.begin(), clip.end(), out.begin()); kernels->normalize(out.data(), out.size());});
+			report("normalize (incl. copy)", maxError(refOut, out), refTime, time);
+		}
+
+		// float to int16
+		{
+			std::vector<int16_t> refOut(clipLength), out(clipLength);
+			float refTime = timeKernel([&]() {ref.floatToInt16(clip.data(), clip.size(), 32767.0f, refOut.data());});
+			float time = timeKernel([&]() {kernels->floatToInt16(clip.data(), clip.size(), 32767.0f, out.data());});
+			report("float to int16", maxError(refOut, out), refTime, time);
+		}
+	}
+	std::cout << (equivalent ? "all kernels equivalent" : "kernel mismatch!") << std::endl;
+	return equivalent;
+}
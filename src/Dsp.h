@@ -0,0 +1,63 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// audio DSP kernel table for one instruction set
+///
+/// the kernels make no allocations and are safe to call from the audio thread
+typedef struct DspKernels {
+
+	/// instruction set name
+	const char *name;
+
+	/// copy channel out of frames of interleaved samples into out,
+	/// returns the sum of squares of the copied samples
+	float (*deinterleaveSumSquares)(const float *in, std::size_t frames,
+	                                std::size_t channels, std::size_t channel, float *out);
+
+	/// average each factor input samples into outLength output samples,
+	/// factors 2, 3, and 6 are specialized
+	void (*decimate)(const float *in, std::size_t outLength, std::size_t factor, float *out);
+
+	/// sum each factor int16 input samples times scale into outLength float
+	/// output samples, factors 1, 2, 3, and 6 are specialized
+	void (*decimateInt16)(const int16_t *in, std::size_t outLength, std::size_t factor,
+	                      float scale, float *out);
+
+	/// scale in place by 1 / max abs, returns max abs, leaves silence as is
+	float (*normalize)(float *data, std::size_t length);
+
+	/// convert to int16 times scale, clamped to +-32767 & truncated
+	void (*floatToInt16)(const float *in, std::size_t length, float scale, int16_t *out);
+
+} DspKernels;
+
+/// returns the fastest kernels supported by this cpu, selected on first call
+const DspKernels & dsp();
+
+/// returns all kernels supported by this cpu, scalar first & fastest last
+std::vector<const DspKernels*> dspSupported();
+
+/// returns the reference kernels, the original scalar loops
+const DspKernels & dspReference();
+
+/// check each supported kernel set against the reference and print max
+/// error and speedup per kernel, returns true if all are equivalent
+bool dspBenchmark();
@@ -0,0 +1,213 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// latency histogram in microseconds with log-linear buckets, HDR style:
+/// exact below 16 us, then 16 buckets per power of two so each value is
+/// kept within 6.25%, up to about 71 minutes
+///
+/// each recording thread writes to its own shard with plain relaxed loads
+/// & stores, so record() takes no locks and makes no atomic read-modify-write
+/// operations, ie. for the audio thread, while readers sum the shards
+///
+/// reset() keeps the current counts as a baseline which is subtracted from
+/// later summaries, so writers are never interrupted, each shard's max is
+/// cleared by its writer on its next record()
+///
+/// totals() ignores the baseline and returns cumulative counts since setup,
+/// ie. for Prometheus which expects counters to only ever increase
+class LatencyHistogram {
+
+	public:
+
+		/// summary since the last reset, values in us
+		typedef struct Summary {
+			uint64_t count = 0;
+			uint64_t p50 = 0;
+			uint64_t p90 = 0;
+			uint64_t p99 = 0;
+			uint64_t max = 0;
+		} Summary;
+
+		/// constructor with number of writer threads
+		explicit LatencyHistogram(std::size_t numShards=1) {setup(numShards);}
+
+		// non-copyable
+		LatencyHistogram(LatencyHistogram const &) = delete;
+		LatencyHistogram& operator=(const LatencyHistogram &) = delete;
+
+		/// set number of writer threads, clears all counts,
+		/// call before any thread records
+		void setup(std::size_t numShards) {
+			std::lock_guard<std::mutex> lock(mutex);
+			this->numShards = (numShards > 0 ? numShards : 1);
+			shards.reset(new Shard[this->numShards]);
+			baseline.assign(numBuckets, 0);
+			epoch.store(0, std::memory_order_relaxed);
+		}
+
+		/// record a value in us from the shard's writer thread,
+		/// out of range shards are ignored
+		void record(std::size_t shard, uint64_t us) {
+			if(shard >= numShards) {return;}
+			Shard & s = shards[shard];
+			uint32_t e = epoch.load(std::memory_order_relaxed);
+			if(s.epoch != e) {
+				// reset requested, start a new max
+				s.max.store(0, std::memory_order_relaxed);
+				s.epoch = e;
+			}
+			std::atomic<uint64_t> & count = s.counts[bucket(us)];
+			count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			s.sum.store(s.sum.load(std::memory_order_relaxed) + us, std::memory_order_relaxed);
+			if(us > s.max.load(std::memory_order_relaxed)) {
+				s.max.store(us, std::memory_order_relaxed);
+			}
+		}
+
+		/// summarize all shards since the last reset
+		Summary summarize() const {
+			std::lock_guard<std::mutex> lock(mutex);
+			std::vector<uint64_t> counts;
+			sum(counts);
+			Summary summary;
+			for(std::size_t i = 0; i < numBuckets; i++) {
+				counts[i] = (counts[i] > baseline[i] ? counts[i] - baseline[i] : 0);
+				summary.count += counts[i];
+			}
+			if(summary.count == 0) {return summary;}
+
+			// max since reset, may still include an older max for shards
+			// which have not recorded since, so limit to the highest bucket
+			std::size_t highest = numBuckets - 1;
+			while(highest > 0 && counts[highest] == 0) {highest--;}
+			for(std::size_t i = 0; i < numShards; i++) {
+				summary.max = std::max(summary.max, shards[i].max.load(std::memory_order_relaxed));
+			}
+			summary.max = std::min(summary.max, upperBound(highest));
+			summary.p50 = percentile(counts, summary.count, 0.50, summary.max);
+			summary.p90 = percentile(counts, summary.count, 0.90, summary.max);
+			summary.p99 = percentile(counts, summary.count, 0.99, summary.max);
+			return summary;
+		}
+
+		/// cumulative totals since setup: counts[i] is the number of values
+		/// at or below bounds[i] in us, rounded down to the nearest bucket
+		/// boundary, bounds must be ascending, also returns the total count &
+		/// sum of all values in us
+		void totals(const std::vector<uint64_t> & bounds, std::vector<uint64_t> & counts,
+		            uint64_t & count, uint64_t & total) const {
+			std::lock_guard<std::mutex> lock(mutex);
+			std::vector<uint64_t> buckets;
+			sum(buckets);
+			counts.assign(bounds.size(), 0);
+			count = 0;
+			std::size_t bound = 0;
+			for(std::size_t i = 0; i < numBuckets; i++) {
+				while(bound < bounds.size() && upperBound(i) > bounds[bound]) {
+					counts[bound++] = count;
+				}
+				count += buckets[i];
+			}
+			while(bound < bounds.size()) {
+				counts[bound++] = count;
+			}
+			total = 0;
+			for(std::size_t i = 0; i < numShards; i++) {
+				total += shards[i].sum.load(std::memory_order_relaxed);
+			}
+		}
+
+		/// start counting from zero
+		void reset() {
+			std::lock_guard<std::mutex> lock(mutex);
+			sum(baseline);
+			epoch.fetch_add(1, std::memory_order_relaxed);
+		}
+
+	private:
+
+		static const std::size_t subBuckets = 16; //< per power of two
+		static const std::size_t numBuckets = 29 * subBuckets; //< up to 2^32 us
+
+		/// per writer thread counts, padded to avoid false sharing
+		struct Shard {
+			std::atomic<uint64_t> counts[numBuckets];
+			std::atomic<uint64_t> max{0};
+			std::atomic<uint64_t> sum{0}; //< since setup
+			uint32_t epoch = 0; //< writer only
+			char padding[64];
+			Shard() {
+				for(auto & count : counts) {count.store(0, std::memory_order_relaxed);}
+			}
+		};
+
+		/// bucket index for a value in us
+		static std::size_t bucket(uint64_t us) {
+			if(us < subBuckets) {return (std::size_t)us;}
+			if(us >= ((uint64_t)1 << 32)) {return numBuckets - 1;}
+			std::size_t exponent = 63 - __builtin_clzll(us); // >= 4
+			std::size_t sub = (std::size_t)(us >> (exponent - 4)) & (subBuckets - 1);
+			return (exponent - 3) * subBuckets + sub;
+		}
+
+		/// highest value in us which falls into a bucket
+		static uint64_t upperBound(std::size_t index) {
+			if(index < subBuckets) {return index;}
+			std::size_t exponent = index / subBuckets + 3;
+			uint64_t sub = index % subBuckets;
+			return ((subBuckets + sub + 1) << (exponent - 4)) - 1;
+		}
+
+		/// sum shard counts into counts
+		void sum(std::vector<uint64_t> & counts) const {
+			counts.assign(numBuckets, 0);
+			for(std::size_t i = 0; i < numShards; i++) {
+				for(std::size_t b = 0; b < numBuckets; b++) {
+					counts[b] += shards[i].counts[b].load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		/// value in us below which a fraction of the counts fall, reported as
+		/// the bucket's upper bound limited to max
+		static uint64_t percentile(const std::vector<uint64_t> & counts, uint64_t total,
+		                           double fraction, uint64_t max) {
+			uint64_t rank = (uint64_t)(fraction * total + 0.5);
+			if(rank < 1) {rank = 1;}
+			uint64_t seen = 0;
+			for(std::size_t i = 0; i < counts.size(); i++) {
+				seen += counts[i];
+				if(seen >= rank) {
+					return std::min(upperBound(i), max);
+				}
+			}
+			return max;
+		}
+
+		std::unique_ptr<Shard[]> shards;
+		std::size_t numShards = 0;
+		std::vector<uint64_t> baseline; //< counts at the last reset, guarded by mutex
+		std::atomic<uint32_t> epoch{0}; //< incremented on reset
+		mutable std::mutex mutex; //< readers only
+};
@@ -0,0 +1,135 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#include "MemoryLock.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// page size, for rounding ranges
+static std::size_t pageSize() {
+	static const std::size_t size = (std::size_t)sysconf(_SC_PAGESIZE);
+	return size;
+}
+
+bool MemoryLock::lockAll() {
+#ifdef __linux__
+	if(allLocked) {return true;}
+	if(mlockall(MCL_CURRENT) != 0) {
+		if(!raiseLimit() || mlockall(MCL_CURRENT) != 0) {
+			return false;
+		}
+	}
+	allLocked = true;
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool MemoryLock::lock(const void *data, std::size_t bytes) {
+	if(!data || bytes == 0) {return true;}
+
+	// round out to whole pages
+	uintptr_t start = (uintptr_t)data & ~(uintptr_t)(pageSize() - 1);
+	uintptr_t end = ((uintptr_t)data + bytes + pageSize() - 1) & ~(uintptr_t)(pageSize() - 1);
+	Range range = {(const void *)start, (std::size_t)(end - start)};
+	if(mlock(range.data, range.bytes) != 0) {
+		if(!raiseLimit() || mlock(range.data, range.bytes) != 0) {
+			failed++;
+			return false;
+		}
+	}
+
+	// mlock faults pages in on linux, touch them anyway for other systems
+	const volatile char *page = (const volatile char *)range.data;
+	for(std::size_t offset = 0; offset < range.bytes; offset += pageSize()) {
+		(void)page[offset];
+	}
+
+	ranges.push_back(range);
+	return true;
+}
+
+void MemoryLock::unlock() {
+#ifdef __linux__
+	if(allLocked) {
+		munlockall();
+		allLocked = false;
+		ranges.clear();
+		return;
+	}
+#endif
+	for(auto &range : ranges) {
+		munlock(range.data, range.bytes);
+	}
+	ranges.clear();
+}
+
+std::size_t MemoryLock::getLockedBytes() const {
+#ifdef __linux__
+	if(allLocked) {
+		// VmLck: locked process memory in kB
+		std::ifstream status("/proc/self/status");
+		std::string key;
+		std::size_t kb = 0;
+		while(status >> key) {
+			if(key == "VmLck:" && status >> kb) {
+				return kb * 1024;
+			}
+		}
+	}
+#endif
+
+	// ranges may share pages, ie. small buffers next to each other on the
+	// heap, so count the union of the ranges
+	std::vector<Range> sorted(ranges);
+	std::sort(sorted.begin(), sorted.end(), [](const Range & a, const Range & b) {
+		return a.data < b.data;
+	});
+	std::size_t bytes = 0;
+	uintptr_t covered = 0; // end of the ranges counted so far
+	for(auto &range : sorted) {
+		uintptr_t start = std::max((uintptr_t)range.data, covered);
+		uintptr_t end = (uintptr_t)range.data + range.bytes;
+		if(end > start) {
+			bytes += end - start;
+			covered = end;
+		}
+	}
+	return bytes;
+}
+
+std::size_t MemoryLock::getLimit() {
+	struct rlimit limit;
+	if(getrlimit(RLIMIT_MEMLOCK, &limit) != 0) {
+		return 0;
+	}
+	return (limit.rlim_cur == RLIM_INFINITY ? SIZE_MAX : (std::size_t)limit.rlim_cur);
+}
+
+bool MemoryLock::raiseLimit() {
+	struct rlimit limit;
+	if(getrlimit(RLIMIT_MEMLOCK, &limit) != 0 || limit.rlim_cur == limit.rlim_max) {
+		return false;
+	}
+	limit.rlim_cur = limit.rlim_max;
+	return setrlimit(RLIMIT_MEMLOCK, &limit) == 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/// locks memory into RAM so it can't be paged out during quiet periods,
+/// pages are faulted in when locked
+///
+/// locking is limited by RLIMIT_MEMLOCK, the soft limit is raised to the hard
+/// limit if needed, failures are reported and leave memory unlocked
+class MemoryLock {
+
+	public:
+
+		~MemoryLock() {unlock();}
+
+		/// lock all currently mapped process memory, ie. model weights,
+		/// future allocations are not locked, linux only,
+		/// returns true on success
+		bool lockAll();
+
+		/// lock and prefault a memory range, returns true on success
+		bool lock(const void *data, std::size_t bytes);
+
+		/// unlock all locked memory
+		void unlock();
+
+		/// returns true if all process memory was locked by lockAll()
+		bool isAllLocked() const {return allLocked;}
+
+		/// returns locked bytes, process total after lockAll() otherwise
+		/// the size of the pages covered by locked ranges, each counted once
+		std::size_t getLockedBytes() const;
+
+		/// returns current soft RLIMIT_MEMLOCK in bytes, 0 if unknown
+		static std::size_t getLimit();
+
+		/// number of ranges which could not be locked
+		std::size_t failed = 0;
+
+	private:
+
+		/// try raising the soft RLIMIT_MEMLOCK to the hard limit,
+		/// returns true if raised
+		static bool raiseLimit();
+
+		/// locked range
+		typedef struct Range {
+			const void *data;
+			std::size_t bytes;
+		} Range;
+
+		std::vector<Range> ranges;
+		bool allLocked = false;
+};
@@ -0,0 +1,176 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#include "MetricsServer.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+	#include <mach/mach.h>
+#endif
+
+#include "ofMain.h"
+#include "config.h"
+
+// ms between checks for stop while no connections arrive
+static const int pollInterval = 100;
+
+// max request size in bytes, only the request line is used
+static const std::size_t maxRequestSize = 4096;
+
+// seconds to wait for a slow client before giving up
+static const int clientTimeout = 2;
+
+//--------------------------------------------------------------
+bool MetricsServer::start(int port, Callback callback) {
+	stop();
+	socket = ::socket(AF_INET, SOCK_STREAM, 0);
+	if(socket < 0) {
+		ofLogError(PACKAGE) << "metrics: could not open socket: " << std::strerror(errno);
+		return false;
+	}
+	fcntl(socket, F_SETFD, FD_CLOEXEC); // not for command children
+	int reuse = 1;
+	setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	struct sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if(bind(socket, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(socket, 4) != 0) {
+		ofLogError(PACKAGE) << "metrics: could not listen on port " << port << ": " << std::strerror(errno);
+		close(socket);
+		socket = -1;
+		return false;
+	}
+	this->callback = callback;
+	running = true;
+	thread = std::thread([this]() {run();});
+	return true;
+}
+
+void MetricsServer::stop() {
+	running = false;
+	if(thread.joinable()) {
+		thread.join();
+	}
+	if(socket >= 0) {
+		close(socket);
+		socket = -1;
+	}
+}
+
+//--------------------------------------------------------------
+void MetricsServer::run() {
+	while(running.load(std::memory_order_relaxed)) {
+		struct pollfd fd = {socket, POLLIN, 0};
+		if(poll(&fd, 1, pollInterval) <= 0) {continue;}
+		int connection = accept(socket, nullptr, nullptr);
+		if(connection < 0) {continue;}
+		fcntl(connection, F_SETFD, FD_CLOEXEC);
+		struct timeval timeout = {clientTimeout, 0};
+		setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		serve(connection);
+		close(connection);
+	}
+}
+
+void MetricsServer::serve(int connection) {
+
+	// read until the end of the headers, the body is ignored
+	std::string request;
+	char buffer[1024];
+	while(request.find("\r\n\r\n") == std::string::npos && request.size() < maxRequestSize) {
+		ssize_t n = recv(connection, buffer, sizeof(buffer), 0);
+		if(n <= 0) {return;}
+		request.append(buffer, n);
+	}
+
+	// request line: METHOD PATH VERSION
+	std::istringstream line(request.substr(0, request.find("\r\n")));
+	std::string method, path;
+	line >> method >> path;
+	std::string status = "200 OK", body;
+	if(method != "GET" && method != "HEAD") {
+		status = "405 Method Not Allowed";
+	}
+	else if(path != "/metrics" && path != "/") {
+		status = "404 Not Found";
+	}
+	else {
+		body = callback();
+		requests.fetch_add(1, std::memory_order_relaxed);
+	}
+	std::string response = "HTTP/1.1 " + status + "\r\n"
+		"Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+		"Content-Length: " + ofToString(body.size()) + "\r\n"
+		"Connection: close\r\n\r\n";
+	if(method != "HEAD") {
+		response += body;
+	}
+	const char *data = response.data();
+	std::size_t remaining = response.size();
+	while(remaining > 0) {
+		ssize_t n = send(connection, data, remaining, MSG_NOSIGNAL);
+		if(n <= 0) {return;}
+		data += n;
+		remaining -= n;
+	}
+}
+
+//--------------------------------------------------------------
+std::string metricLine(const std::string & name, const std::string & labels, double value) {
+	char number[32];
+	if(value == std::floor(value) && std::fabs(value) < 1e15) {
+		std::snprintf(number, sizeof(number), "%.0f", value);
+	}
+	else {
+		std::snprintf(number, sizeof(number), "%.9g", value);
+	}
+	return name + (labels.empty() ? "" : "{" + labels + "}") + " " + number + "\n";
+}
+
+uint64_t residentMemory() {
+#if defined(__APPLE__)
+	mach_task_basic_info_data_t info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if(task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+		return 0;
+	}
+	return info.resident_size;
+#elif defined(__linux__)
+	// second field is resident pages
+	FILE *file = std::fopen("/proc/self/statm", "r");
+	if(!file) {return 0;}
+	unsigned long long size = 0, resident = 0;
+	int read = std::fscanf(file, "%llu %llu", &size, &resident);
+	std::fclose(file);
+	return (read == 2 ? resident * (uint64_t)sysconf(_SC_PAGESIZE) : 0);
+#else
+	return 0;
+#endif
+}
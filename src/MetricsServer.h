@@ -0,0 +1,73 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+/// minimal HTTP server for Prometheus scraping, bound to localhost
+///
+/// serves GET /metrics from its own thread, one connection at a time, with
+/// the text returned by a callback which is run in the server thread and
+/// must only read state which is safe to read from any thread, ie. atomics
+class MetricsServer {
+
+	public:
+
+		/// metrics text callback, called in the server thread
+		typedef std::function<std::string()> Callback;
+
+		MetricsServer() {}
+		~MetricsServer() {stop();}
+
+		// non-copyable
+		MetricsServer(MetricsServer const &) = delete;
+		MetricsServer& operator=(const MetricsServer &) = delete;
+
+		/// bind 127.0.0.1 port & start server thread, returns true on success
+		bool start(int port, Callback callback);
+
+		/// stop server thread & close port
+		void stop();
+
+		/// returns true if running
+		bool isRunning() const {return running;}
+
+		std::atomic<uint64_t> requests{0}; //< requests served
+
+	private:
+
+		/// server thread loop
+		void run();
+
+		/// read request & send response on a connection
+		void serve(int connection);
+
+		int socket = -1;
+		Callback callback;
+		std::thread thread;
+		std::atomic<bool> running{false};
+};
+
+/// format a Prometheus metric line, ie. "name{labels} value\n",
+/// labels may be empty
+std::string metricLine(const std::string & name, const std::string & labels, double value);
+
+/// resident memory of this process in bytes, 0 if unknown
+uint64_t residentMemory();
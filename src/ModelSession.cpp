@@ -0,0 +1,334 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#include "ModelSession.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "ofMain.h"
+#include "config.h"
+#include "AllocCheck.h"
+
+/// minimal protobuf writer for the handful of tensorflow.ConfigProto fields
+/// we set, avoids depending on the generated protobuf classes which are not
+/// part of the TensorFlow C library
+class ConfigProto {
+
+	public:
+
+		/// add varint field
+		void addVarint(int field, uint64_t value) {
+			writeVarint((uint64_t)(field << 3) | 0);
+			writeVarint(value);
+		}
+
+		/// add embedded message field
+		void addMessage(int field, const ConfigProto &message) {
+			writeVarint((uint64_t)(field << 3) | 2);
+			writeVarint(message.bytes.size());
+			bytes += message.bytes;
+		}
+
+		std::string bytes;
+
+	private:
+
+		void writeVarint(uint64_t value) {
+			while(value >= 0x80) {
+				bytes += (char)((value & 0x7F) | 0x80);
+				value >>= 7;
+			}
+			bytes += (char)value;
+		}
+};
+
+// tensorflow/core/protobuf/config.proto field numbers
+enum {
+	CONFIG_INTRA_OP_THREADS = 2,
+	CONFIG_INTER_OP_THREADS = 5,
+	CONFIG_PER_SESSION_THREADS = 9,
+	CONFIG_GRAPH_OPTIONS = 10,
+	CONFIG_EXPERIMENTAL = 16,
+	EXPERIMENTAL_DISABLE_THREAD_SPINNING = 9,
+	GRAPH_OPTIMIZER_OPTIONS = 3,
+	OPTIMIZER_GLOBAL_JIT_LEVEL = 5,
+	JIT_LEVEL_ON_1 = 1
+};
+
+// enable XLA global jit on cpu and/or point XLA's persistent compilation
+// cache at dir, only read by TensorFlow once so this needs to happen before
+// the first session is created
+static void setXlaFlags(const std::string &dir, bool globalJit) {
+	static bool set = false;
+	if(set) {return;}
+	std::string flags = "";
+	const char *env = std::getenv("TF_XLA_FLAGS");
+	if(env) {
+		flags = std::string(env);
+	}
+	if(globalJit) {
+		flags += " --tf_xla_cpu_global_jit";
+	}
+	if(dir != "") {
+		flags += " --tf_xla_persistent_cache_directory=" + dir;
+	}
+	setenv("TF_XLA_FLAGS", flags.c_str(), 1);
+	set = true;
+}
+
+// stop OpenMP threads used by oneDNN builds from busy waiting after work,
+// only read when the OpenMP runtime starts so this needs to happen before the
+// first session is created, keeps any values already set in the environment
+static void setNoSpinFlags() {
+	setenv("OMP_WAIT_POLICY", "PASSIVE", 0);
+	setenv("KMP_BLOCKTIME", "0", 0);
+}
+
+// FNV-1a hash of file contents, returns false if the file could not be read
+static bool hashFile(const std::string &path, uint64_t &hash) {
+	std::ifstream file(path, std::ios::binary);
+	if(!file.is_open()) {
+		return false;
+	}
+	char buffer[4096];
+	while(file) {
+		file.read(buffer, sizeof(buffer));
+		for(std::streamsize i = 0; i < file.gcount(); i++) {
+			hash ^= (uint8_t)buffer[i];
+			hash *= 1099511628211ULL;
+		}
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+ModelSession::ModelSession() {
+	status = TF_NewStatus();
+}
+
+ModelSession::~ModelSession() {
+	clear();
+	TF_DeleteStatus(status);
+}
+
+bool ModelSession::load(const std::string &modelPath, const SessionSettings &settings) {
+	clear();
+
+	// session config
+	ConfigProto config;
+	if(settings.intraOpThreads > 0) {
+		config.addVarint(CONFIG_INTRA_OP_THREADS, settings.intraOpThreads);
+	}
+	if(settings.interOpThreads > 0) {
+		config.addVarint(CONFIG_INTER_OP_THREADS, settings.interOpThreads);
+	}
+	if(settings.perSessionThreads) {
+		config.addVarint(CONFIG_PER_SESSION_THREADS, 1);
+	}
+	if(!settings.spinWait) {
+		// idle pool threads sleep right away instead of burning cpu
+		ConfigProto experimental;
+		experimental.addVarint(EXPERIMENTAL_DISABLE_THREAD_SPINNING, 1);
+		config.addMessage(CONFIG_EXPERIMENTAL, experimental);
+		setNoSpinFlags();
+	}
+	if(settings.globalJit) {
+		// jit compile clusters of the whole graph, not only those the model
+		// marks for compilation
+		ConfigProto optimizer;
+		optimizer.addVarint(OPTIMIZER_GLOBAL_JIT_LEVEL, JIT_LEVEL_ON_1);
+		ConfigProto graphOptions;
+		graphOptions.addMessage(GRAPH_OPTIMIZER_OPTIONS, optimizer);
+		config.addMessage(CONFIG_GRAPH_OPTIONS, graphOptions);
+	}
+	if(settings.globalJit || settings.cacheDir != "") {
+		setXlaFlags(settings.cacheDir, settings.globalJit);
+	}
+	TF_SessionOptions *options = TF_NewSessionOptions();
+	TF_SetConfig(options, config.bytes.data(), config.bytes.size(), status);
+	if(TF_GetCode(status) != TF_OK) {
+		ofLogError(PACKAGE) << "invalid session config: " << TF_Message(status);
+		TF_DeleteSessionOptions(options);
+		return false;
+	}
+
+	// load SavedModel
+	const char *tag = "serve";
+	graph = TF_NewGraph();
+	session = TF_LoadSessionFromSavedModel(options, nullptr, modelPath.c_str(),
+	                                       &tag, 1, graph, nullptr, status);
+	TF_DeleteSessionOptions(options);
+	if(TF_GetCode(status) != TF_OK) {
+		ofLogError(PACKAGE) << "could not load model " << modelPath << ": " << TF_Message(status);
+		session = nullptr;
+		clear();
+		return false;
+	}
+
+	// look up input & output ops
+	input = {TF_GraphOperationByName(graph, inputName.c_str()), 0};
+	output = {TF_GraphOperationByName(graph, outputName.c_str()), 0};
+	if(!input.oper || !output.oper) {
+		ofLogError(PACKAGE) << "model " << modelPath << " is missing operation "
+		                    << (input.oper ? outputName : inputName);
+		clear();
+		return false;
+	}
+
+	return true;
+}
+
+void ModelSession::clear() {
+	if(session) {
+		TF_CloseSession(session, status);
+		TF_DeleteSession(session, status);
+		session = nullptr;
+	}
+	if(graph) {
+		TF_DeleteGraph(graph);
+		graph = nullptr;
+	}
+	input = {nullptr, 0};
+	output = {nullptr, 0};
+	for(auto tensor : inputs) {
+		if(tensor) {
+			TF_DeleteTensor(tensor);
+		}
+	}
+	inputs.clear();
+	inputLength = 0;
+}
+
+void ModelSession::reserve(std::size_t maxBatch, std::size_t length) {
+	for(std::size_t batch = 1; batch <= maxBatch; batch++) {
+		inputData(batch, length);
+	}
+}
+
+void ModelSession::lock(MemoryLock &memory) {
+	for(auto tensor : inputs) {
+		if(tensor) {
+			memory.lock(TF_TensorData(tensor), TF_TensorByteSize(tensor));
+		}
+	}
+}
+
+float* ModelSession::inputData(std::size_t batch, std::size_t length) {
+	if(length != inputLength) {
+		// new shape, drop tensors for the previous length
+		for(auto tensor : inputs) {
+			if(tensor) {
+				TF_DeleteTensor(tensor);
+			}
+		}
+		inputs.clear();
+		inputLength = length;
+	}
+	if(inputs.size() < batch) {
+		inputs.resize(batch, nullptr);
+	}
+	TF_Tensor *&tensor = inputs[batch - 1];
+	if(!tensor) {
+		const int64_t dims[3] = {(int64_t)batch, (int64_t)length, 1};
+		tensor = TF_AllocateTensor(TF_FLOAT, dims, 3, batch * length * sizeof(float));
+	}
+	return (float *)TF_TensorData(tensor);
+}
+
+bool ModelSession::run(std::size_t batch, std::size_t length, std::vector<float> &results) {
+	if(!session) {
+		return false;
+	}
+	TF_Tensor *inputTensor = nullptr;
+	if(length == inputLength && batch <= inputs.size()) {
+		inputTensor = inputs[batch - 1];
+	}
+	if(!inputTensor) {
+		ofLogError(PACKAGE) << "inference failed: no input for batch " << batch << " length " << length;
+		return false;
+	}
+
+	// inference, TensorFlow allocates internally
+	TF_Tensor *outputTensor = nullptr;
+	{
+		AllocCheck::Allow allow;
+		TF_SessionRun(session, nullptr,
+		              &input, &inputTensor, 1,
+		              &output, &outputTensor, 1,
+		              nullptr, 0, nullptr, status);
+		if(TF_GetCode(status) != TF_OK) {
+			ofLogError(PACKAGE) << "inference failed: " << TF_Message(status);
+			return false;
+		}
+	}
+
+	// copy results
+	const float *data = (const float *)TF_TensorData(outputTensor);
+	results.assign(data, data + TF_TensorByteSize(outputTensor) / sizeof(float));
+	TF_DeleteTensor(outputTensor);
+
+	return true;
+}
+
+bool ModelSession::run(const float *samples, std::size_t batch, std::size_t length,
+                       std::vector<float> &results) {
+	if(!session) {
+		return false;
+	}
+	std::memcpy(inputData(batch, length), samples, batch * length * sizeof(float));
+	return run(batch, length, results);
+}
+
+//--------------------------------------------------------------
+bool hashModel(const std::string &modelPath, std::string &hash) {
+	// the variables index holds checksums for the variable data
+	// so there is no need to hash the larger data shard
+	uint64_t value = 14695981039346656037ULL;
+	if(!hashFile(ofFilePath::join(modelPath, "saved_model.pb"), value) ||
+	   !hashFile(ofFilePath::join(modelPath, "variables/variables.index"), value)) {
+		return false;
+	}
+	std::stringstream stream;
+	stream << std::hex << std::setw(16) << std::setfill('0') << value;
+	hash = stream.str();
+	return true;
+}
+
+//--------------------------------------------------------------
+bool GraphCache::setup(const std::string &baseDir, const std::string &modelPath) {
+
+	// key by model content & TF version
+	if(!hashModel(modelPath, modelHash)) {
+		ofLogWarning(PACKAGE) << "graph cache: could not read model files in " << modelPath;
+		return false;
+	}
+	path = ofFilePath::join(baseDir, modelHash + "-tf" + TF_Version());
+
+	// create or check existing cache contents
+	if(ofDirectory::doesDirectoryExist(path, false)) {
+		ofDirectory dir(path);
+		warm = (dir.listDir() > 0);
+	}
+	else if(!ofDirectory::createDirectory(path, false, true)) {
+		ofLogWarning(PACKAGE) << "graph cache: could not create " << path;
+		path = "";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,120 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "tensorflow/c/c_api.h"
+#include "MemoryLock.h"
+
+/// settings applied when creating a model session
+struct SessionSettings {
+	std::string cacheDir = ""; //< compiled graph cache directory, disabled if empty
+	bool globalJit = false;    //< XLA jit compile the whole graph on cpu
+	int intraOpThreads = 0;    //< threads used within a single op, 0 for TF default
+	int interOpThreads = 0;    //< threads used to run independent ops, 0 for TF default
+	bool spinWait = true;      //< let idle pool threads spin before sleeping
+	bool perSessionThreads = false; //< own thread pools instead of process-wide pools
+};
+
+/// SavedModel inference session using the TensorFlow C api directly
+///
+/// cppflow creates its sessions with default options, so this is used instead
+/// when the session config needs to be set, ie. graph compilation caching
+class ModelSession {
+
+	public:
+
+		ModelSession();
+		~ModelSession();
+
+		// non-copyable
+		ModelSession(ModelSession const &) = delete;
+		ModelSession& operator=(const ModelSession &) = delete;
+
+		/// load SavedModel from directory path with session settings,
+		/// returns true on success
+		bool load(const std::string &modelPath, const SessionSettings &settings);
+
+		/// close session and free resources
+		void clear();
+
+		/// returns true if a model is loaded
+		bool isLoaded() const {return session != nullptr;}
+
+		/// preallocate input tensors for batches of 1 to maxBatch samples
+		/// with given length
+		void reserve(std::size_t maxBatch, std::size_t length);
+
+		/// returns input tensor memory for a batch of float samples with shape
+		/// {batch, length, 1} to fill before run(), allocated if not reserved
+		float* inputData(std::size_t batch, std::size_t length);
+
+		/// run the batch of samples written to inputData(), sets output to the
+		/// flattened {batch, classes} results, output is only reallocated if
+		/// too small, returns true on success
+		bool run(std::size_t batch, std::size_t length, std::vector<float> &output);
+
+		/// lock reserved input tensor memory into RAM
+		void lock(MemoryLock &memory);
+
+		/// copy a batch of float input samples with shape {batch, length, 1}
+		/// into the input tensor and run, returns true on success
+		bool run(const float *input, std::size_t batch, std::size_t length,
+		         std::vector<float> &output);
+
+		/// model input & output operation names
+		std::string inputName = "serving_default_input_1";
+		std::string outputName = "StatefulPartitionedCall";
+
+	private:
+
+		TF_Graph *graph = nullptr;
+		TF_Session *session = nullptr;
+		TF_Status *status = nullptr;
+		TF_Output input = {nullptr, 0};
+		TF_Output output = {nullptr, 0};
+		std::vector<TF_Tensor*> inputs; //< input tensors by batch size - 1
+		std::size_t inputLength = 0; //< input tensor sample length
+};
+
+/// hash SavedModel contents at modelPath into a hex string,
+/// returns true on success
+bool hashModel(const std::string &modelPath, std::string &hash);
+
+/// compiled graph cache for a given model, keyed by model hash & TF version
+class GraphCache {
+
+	public:
+
+		/// set up cache subdirectory in baseDir for the model at modelPath,
+		/// returns true if the directory is usable
+		bool setup(const std::string &baseDir, const std::string &modelPath);
+
+		/// returns true if the cache already holds compiled graphs
+		bool isWarm() const {return warm;}
+
+		/// cache subdirectory path for the current model
+		std::string path = "";
+
+		/// model content hash, hex string
+		std::string modelHash = "";
+
+	private:
+
+		bool warm = false;
+};
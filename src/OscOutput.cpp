@@ -0,0 +1,306 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#include "OscOutput.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ofMain.h"
+#include "config.h"
+#include "osc/OscOutboundPacketStream.h"
+
+// seconds between attempts to resolve a destination host, doubled after
+// each failed round up to the max
+static const int resolveInterval = 5;
+static const int maxResolveInterval = 60;
+
+// OSC timetag for the current time: NTP seconds since 1900 in the upper
+// 32 bits and the fraction in the lower 32 bits
+static osc::uint64 timetagNow() {
+	auto now = std::chrono::system_clock::now().time_since_epoch();
+	auto seconds = std::chrono::duration_cast<std::chrono::seconds>(now);
+	auto fraction = std::chrono::duration_cast<std::chrono::nanoseconds>(now - seconds);
+	osc::uint64 ntpSeconds = (osc::uint64)seconds.count() + 2208988800ULL;
+	osc::uint64 ntpFraction = ((osc::uint64)fraction.count() << 32) / 1000000000ULL;
+	return (ntpSeconds << 32) | ntpFraction;
+}
+
+//--------------------------------------------------------------
+OscOutput::OscOutput() :
+	buffer(new char[maxPacketSize]),
+	stream(new osc::OutboundPacketStream(buffer.get(), maxPacketSize)) {}
+
+OscOutput::~OscOutput() {
+	stop();
+}
+
+OscOutput::Destination::~Destination() {
+	if(socket >= 0) {
+		close(socket);
+	}
+}
+
+void OscOutput::addDestination(const std::string & address, int port) {
+	std::shared_ptr<Destination> destination = std::make_shared<Destination>();
+	destination->address = address;
+	destination->port = port;
+	destinations.push_back(destination);
+}
+
+void OscOutput::start(std::size_t capacity) {
+	stop();
+	std::size_t size = 2;
+	while(size < capacity) {size *= 2;}
+	packets.reset(new Packet[size]);
+	mask = size - 1;
+	head = 0;
+	tail = 0;
+	running = true;
+	thread = std::thread([this]() {run();});
+
+	// detached, a lookup blocked in getaddrinfo only holds the shared state
+	resolver = std::make_shared<Resolver>();
+	resolver->destinations = destinations;
+	std::thread(resolve, resolver).detach();
+}
+
+void OscOutput::stop() {
+	if(resolver) {
+		{
+			std::lock_guard<std::mutex> lock(resolver->mutex);
+			resolver->running = false;
+		}
+		resolver->condition.notify_all();
+		resolver.reset();
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	condition.notify_one();
+	if(thread.joinable()) {
+		thread.join();
+	}
+}
+
+bool OscOutput::add(const ofxOscMessage & message) {
+	try {
+		if(!pending) {
+			stream->Clear();
+			*stream << osc::BeginBundle(timetagNow());
+			pendingTime = std::chrono::steady_clock::now();
+			pending = true;
+		}
+		*stream << osc::BeginMessage(message.getAddress().c_str());
+		for(std::size_t i = 0; i < message.getNumArgs(); i++) {
+			switch(message.getArgType(i)) {
+				case OFXOSC_TYPE_INT32: *stream << (osc::int32)message.getArgAsInt32(i); break;
+				case OFXOSC_TYPE_INT64: *stream << (osc::int64)message.getArgAsInt64(i); break;
+				case OFXOSC_TYPE_FLOAT: *stream << message.getArgAsFloat(i); break;
+				case OFXOSC_TYPE_DOUBLE: *stream << message.getArgAsDouble(i); break;
+				case OFXOSC_TYPE_STRING: *stream << message.getArgAsString(i).c_str(); break;
+				case OFXOSC_TYPE_SYMBOL: *stream << osc::Symbol(message.getArgAsSymbol(i).c_str()); break;
+				case OFXOSC_TYPE_CHAR: *stream << message.getArgAsChar(i); break;
+				case OFXOSC_TYPE_TRUE: *stream << true; break;
+				case OFXOSC_TYPE_FALSE: *stream << false; break;
+				case OFXOSC_TYPE_NONE: *stream << osc::OscNil; break;
+				case OFXOSC_TYPE_TRIGGER: *stream << osc::Infinitum; break;
+				default:
+					// drop the whole bundle, a half written message can't be
+					// rolled back
+					pending = false;
+					return false;
+			}
+		}
+		*stream << osc::EndMessage;
+	}
+	catch(const osc::Exception &) {
+		pending = false;
+		return false;
+	}
+	return true;
+}
+
+bool OscOutput::send() {
+	if(!pending) {return true;}
+	pending = false;
+	if(!packets) {return false;}
+	try {
+		*stream << osc::EndBundle;
+	}
+	catch(const osc::Exception &) {
+		return false;
+	}
+
+	// copy into the next free ring slot
+	std::size_t h = head.load(std::memory_order_relaxed);
+	if(h - tail.load(std::memory_order_acquire) > mask) {
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	Packet & packet = packets[h & mask];
+	std::memcpy(packet.data, stream->Data(), stream->Size());
+	packet.size = stream->Size();
+	packet.time = pendingTime;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		head.store(h + 1, std::memory_order_release);
+	}
+	condition.notify_one();
+	return true;
+}
+
+std::string OscOutput::getDestinationName(std::size_t index) const {
+	return destinations[index]->address + " " + ofToString(destinations[index]->port);
+}
+
+void OscOutput::logStats() const {
+	for(std::size_t i = 0; i < destinations.size(); i++) {
+		const Stats & stats = destinations[i]->stats;
+		uint64_t sent = stats.sent.load(std::memory_order_relaxed);
+		uint64_t failed = stats.failed.load(std::memory_order_relaxed);
+		std::string text = "osc " + getDestinationName(i) + ": " +
+			ofToString(sent) + " sent, " + ofToString(failed) + " failed";
+		if(sent > 0) {
+			text += ", latency avg " + ofToString(stats.latencySum.load(std::memory_order_relaxed) / (sent * 1000.0f), 2) +
+			        " ms max " + ofToString(stats.latencyMax.load(std::memory_order_relaxed) / 1000.0f, 2) + " ms";
+		}
+		if(failed > 0) {
+			ofLogWarning(PACKAGE) << text;
+		}
+		else {
+			ofLogVerbose(PACKAGE) << text;
+		}
+	}
+	if(dropped > 0) {
+		ofLogWarning(PACKAGE) << "osc: " << dropped << " bundle(s) dropped, output queue full";
+	}
+}
+
+//--------------------------------------------------------------
+void OscOutput::run() {
+	while(true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this]() {
+				return !running.load(std::memory_order_relaxed) ||
+				       head.load(std::memory_order_relaxed) != tail.load(std::memory_order_relaxed);
+			});
+		}
+		std::size_t t = tail.load(std::memory_order_relaxed);
+		std::size_t h = head.load(std::memory_order_acquire);
+		for(; t != h; t++) {
+			sendPacket(packets[t & mask]);
+			tail.store(t + 1, std::memory_order_release);
+		}
+		if(!running.load(std::memory_order_acquire) &&
+		   head.load(std::memory_order_acquire) == t) {
+			break;
+		}
+	}
+}
+
+void OscOutput::sendPacket(const Packet & packet) {
+	for(auto &destination : destinations) {
+		Stats & stats = destination->stats;
+		if(!destination->ready.load(std::memory_order_acquire) ||
+		   sendto(destination->socket, packet.data, packet.size, MSG_DONTWAIT,
+		          (const struct sockaddr *)destination->addr, destination->addrLength) < 0) {
+			stats.failed.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+		uint64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - packet.time).count();
+		stats.sent.fetch_add(1, std::memory_order_relaxed);
+		stats.latencySum.fetch_add(latency, std::memory_order_relaxed);
+		if(latency > stats.latencyMax.load(std::memory_order_relaxed)) {
+			stats.latencyMax.store(latency, std::memory_order_relaxed);
+		}
+	}
+}
+
+void OscOutput::resolve(std::shared_ptr<Resolver> resolver) {
+	// last error per destination, only logged when it changes
+	std::vector<std::string> errors(resolver->destinations.size());
+	int interval = resolveInterval;
+	while(true) {
+		bool done = true;
+		for(std::size_t i = 0; i < resolver->destinations.size(); i++) {
+			Destination & destination = *resolver->destinations[i];
+			if(destination.ready.load(std::memory_order_acquire)) {continue;}
+			std::string error;
+			bool opened = open(destination, error);
+			done = done && opened;
+			if(error == errors[i]) {continue;}
+
+			// don't log after stop, the app may be shutting down
+			std::lock_guard<std::mutex> lock(resolver->mutex);
+			if(!resolver->running) {return;}
+			if(opened) {
+				ofLogNotice(PACKAGE) << "resolved " << destination.address;
+			}
+			else {
+				ofLogWarning(PACKAGE) << error << ", retrying";
+			}
+			errors[i] = error;
+		}
+		if(done) {return;}
+		std::unique_lock<std::mutex> lock(resolver->mutex);
+		if(resolver->condition.wait_for(lock, std::chrono::seconds(interval),
+		                                [&resolver]() {return !resolver->running;})) {
+			return;
+		}
+		interval = std::min(interval * 2, maxResolveInterval);
+	}
+}
+
+bool OscOutput::open(Destination & destination, std::string & error) {
+	std::lock_guard<std::mutex> lock(destination.mutex); // a restarted resolver may overlap
+	if(destination.ready.load(std::memory_order_acquire)) {return true;}
+
+	// ipv4 only, as with ofxOscSender
+	struct addrinfo hints, *result = nullptr;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	std::string service = ofToString(destination.port);
+	int ret = getaddrinfo(destination.address.c_str(), service.c_str(), &hints, &result);
+	if(ret != 0 || !result) {
+		error = "could not resolve " + destination.address + ": " + gai_strerror(ret);
+		return false;
+	}
+	int fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+	if(fd < 0 || result->ai_addrlen > sizeof(destination.addr)) {
+		error = "could not open socket for " + destination.address;
+		if(fd >= 0) {close(fd);}
+		freeaddrinfo(result);
+		return false;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC); // not for command children
+	int broadcast = 1; // allow broadcast addresses, as with ofxOscSender
+	setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+	std::memcpy(destination.addr, result->ai_addr, result->ai_addrlen);
+	destination.addrLength = result->ai_addrlen;
+	freeaddrinfo(result);
+	destination.socket = fd;
+	destination.ready.store(true, std::memory_order_release);
+	return true;
+}
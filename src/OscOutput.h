@@ -0,0 +1,165 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ofxOsc.h"
+
+namespace osc {
+	class OutboundPacketStream;
+}
+
+/// asynchronous OSC output to one or more UDP destinations
+///
+/// messages added for one event are encoded into a single timetagged bundle
+/// and queued in a preallocated lock-free ring, an output thread sends each
+/// bundle to every resolved destination so unreachable routes never stall
+/// the caller, while a separate resolver thread resolves the destination
+/// hosts so slow name resolution never stalls the output thread, bundles
+/// for destinations which are not resolved yet are counted as failed
+///
+/// single producer: add() & send() may only be called from one thread,
+/// ie. the main thread
+class OscOutput {
+
+	public:
+
+		/// max encoded bundle size in bytes
+		static const std::size_t maxPacketSize = 1024;
+
+		/// per destination counters, updated by the output thread
+		typedef struct Stats {
+			std::atomic<uint64_t> sent{0};      //< bundles sent
+			std::atomic<uint64_t> failed{0};    //< bundles which could not be sent
+			std::atomic<uint64_t> latencySum{0}; //< queue to send latency sum in us
+			std::atomic<uint64_t> latencyMax{0}; //< max queue to send latency in us
+		} Stats;
+
+		OscOutput();
+		~OscOutput();
+
+		// non-copyable
+		OscOutput(OscOutput const &) = delete;
+		OscOutput& operator=(const OscOutput &) = delete;
+
+		/// add a destination host & port, call before start()
+		void addDestination(const std::string & address, int port);
+
+		/// allocate ring with capacity bundles, rounded up to a power of 2,
+		/// and start the output thread
+		void start(std::size_t capacity=64);
+
+		/// send queued bundles then stop the output thread
+		void stop();
+
+		/// add message to the current event's bundle, starts a new bundle
+		/// timetagged with the current time if none is pending, returns false
+		/// if the message could not be encoded
+		bool add(const ofxOscMessage & message);
+
+		/// queue the current event's bundle for sending, if any, returns false
+		/// & counts the drop if the ring is full
+		bool send();
+
+		/// number of destinations
+		std::size_t getNumDestinations() const {return destinations.size();}
+
+		/// destination address & port by index
+		std::string getDestinationName(std::size_t index) const;
+
+		/// destination counters by index
+		const Stats & getStats(std::size_t index) const {return destinations[index]->stats;}
+
+		/// log per destination counters & drops
+		void logStats() const;
+
+		std::atomic<uint64_t> dropped{0}; //< bundles dropped when the ring was full
+
+	private:
+
+		/// queued bundle
+		typedef struct Packet {
+			char data[maxPacketSize];
+			std::size_t size = 0;
+			std::chrono::steady_clock::time_point time; //< time queued
+		} Packet;
+
+		/// destination host, resolved & opened by the resolver thread
+		typedef struct Destination {
+			std::string address;
+			int port = 0;
+			int socket = -1; //< set before ready
+			alignas(16) char addr[128]; //< resolved sockaddr storage, set before ready
+			unsigned int addrLength = 0;
+			std::atomic<bool> ready{false}; //< resolved & open, set once
+			std::mutex mutex; //< guards resolving
+			Stats stats;
+			~Destination();
+		} Destination;
+
+		/// resolver thread state, shared with the detached thread so stop()
+		/// never waits on a slow lookup
+		typedef struct Resolver {
+			std::vector<std::shared_ptr<Destination>> destinations;
+			bool running = true; //< guarded by mutex
+			std::mutex mutex;
+			std::condition_variable condition;
+		} Resolver;
+
+		/// output thread loop
+		void run();
+
+		/// send packet to all ready destinations in the output thread
+		void sendPacket(const Packet & packet);
+
+		/// resolver thread loop, retries failed destinations every few
+		/// seconds until all are ready or stopped
+		static void resolve(std::shared_ptr<Resolver> resolver);
+
+		/// resolve & open destination socket, returns true if ready or
+		/// false & sets error
+		static bool open(Destination & destination, std::string & error);
+
+		std::vector<std::shared_ptr<Destination>> destinations;
+		std::shared_ptr<Resolver> resolver; //< current resolver thread state
+
+		// producer
+		std::unique_ptr<char[]> buffer; //< pending bundle encoding buffer
+		std::unique_ptr<osc::OutboundPacketStream> stream; //< pending bundle
+		bool pending = false; //< bundle started?
+		std::chrono::steady_clock::time_point pendingTime; //< pending bundle time
+
+		// ring
+		std::unique_ptr<Packet[]> packets;
+		std::size_t mask = 0;
+		std::atomic<std::size_t> head{0}; //< next write, producer only
+		std::atomic<std::size_t> tail{0}; //< next read, output thread only
+
+		// output thread, the mutex only guards waiting
+		std::atomic<bool> running{false};
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::thread thread;
+};
@@ -0,0 +1,379 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#include "OutputSink.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <limits.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ofMain.h"
+#include "config.h"
+
+// ms between checks for cancel while a write waits for room
+static const int pollInterval = 100;
+
+// console logging to stderr, keeps stdout for JSON lines
+class StderrLoggerChannel : public ofBaseLoggerChannel {
+	public:
+		void log(ofLogLevel level, const std::string & module, const std::string & message) override {
+			std::cerr << "[" << ofGetLogLevelName(level, true) << "] ";
+			if(module != "") {
+				std::cerr << module << ": ";
+			}
+			std::cerr << message << std::endl;
+		}
+		void log(ofLogLevel level, const std::string & module, const char *format, ...) override {
+			va_list args;
+			va_start(args, format);
+			log(level, module, format, args);
+			va_end(args);
+		}
+		void log(ofLogLevel level, const std::string & module, const char *format, va_list args) override {
+			log(level, module, ofVAArgsToString(format, args));
+		}
+};
+
+// JSON string with quotes & backslashes escaped
+static std::string quote(const std::string & text) {
+	std::string quoted = "\"";
+	for(char c : text) {
+		if(c == '"' || c == '\\') {quoted += '\\';}
+		quoted += c;
+	}
+	return quoted + "\"";
+}
+
+//--------------------------------------------------------------
+void logToStderr() {
+	ofSetLoggerChannel(std::make_shared<StderrLoggerChannel>());
+}
+
+//--------------------------------------------------------------
+bool OutputSink::isValid(const std::string & spec) {
+	return spec == "osc" || spec == "stdout" ||
+	       (spec.compare(0, 5, "unix:") == 0 && spec.size() > 5) ||
+	       (spec.compare(0, 5, "file:") == 0 && spec.size() > 5) ||
+	       (spec.compare(0, 4, "shm:") == 0 && spec.size() > 4 && spec != "shm:/");
+}
+
+std::unique_ptr<OutputSink> OutputSink::create(const std::string & spec, const Labels & labels,
+                                               OscOutput & output) {
+	if(spec == "osc") {
+		return std::unique_ptr<OutputSink>(new OscSink(output));
+	}
+	if(spec == "stdout") {
+		return std::unique_ptr<OutputSink>(new JsonSink("", labels));
+	}
+	if(!isValid(spec)) {
+		return nullptr;
+	}
+	if(spec.compare(0, 4, "shm:") == 0) {
+		return std::unique_ptr<OutputSink>(new BoardSink(spec.substr(4), labels));
+	}
+	std::string path = spec.substr(5);
+	if(spec.compare(0, 5, "unix:") == 0) {
+		return std::unique_ptr<OutputSink>(new UnixSocketSink(path));
+	}
+	return std::unique_ptr<OutputSink>(new JsonSink(path, labels));
+}
+
+std::string OutputSink::toJson(const OutputEvent & event, const Labels & labels) {
+	std::string json = "{\"time\":" + ofToString(event.time, 3);
+	if(event.detecting >= 0) {
+		json += ",\"detecting\":" + ofToString(event.detecting);
+	}
+	if(event.index >= 0) {
+		json += ",\"lang\":{\"index\":" + ofToString(event.index) +
+		        ",\"name\":" + quote(event.label) +
+		        ",\"confidence\":" + std::to_string(event.confidence) + ",\"scores\":{";
+		for(std::size_t i = 0; i < event.scores.size(); i++) {
+			auto label = labels.find((int)i);
+			json += (i > 0 ? "," : "") + quote(label != labels.end() ? label->second : ofToString(i)) +
+			        ":" + std::to_string(event.scores[i]);
+		}
+		json += "}";
+		if(!event.timing.empty()) {
+			json += ",\"timing\":{";
+			for(std::size_t i = 0; i < event.timing.size(); i++) {
+				json += std::string(i > 0 ? "," : "") + quote(ClipTiming::getStageName((ClipTiming::Stage)i)) +
+				        ":" + ofToString(event.timing[i], 3);
+			}
+			json += "}";
+		}
+		json += "}";
+	}
+	return json + "}";
+}
+
+//--------------------------------------------------------------
+bool QueuedSink::start() {
+	if(!open()) {
+		return false;
+	}
+	stopping = false;
+	finished = false;
+	cancelled = false;
+	thread = std::thread([this]() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while(true) {
+			condition.wait(lock, [this]() {return stopping || !events.empty();});
+			if(events.empty() || (stopping && std::chrono::steady_clock::now() >= deadline)) {
+				break;
+			}
+			OutputEvent event = std::move(events.front());
+			events.pop_front();
+			lock.unlock();
+			if(write(event)) {
+				written.fetch_add(1, std::memory_order_relaxed);
+			}
+			else {
+				failed.fetch_add(1, std::memory_order_relaxed);
+			}
+			lock.lock();
+		}
+		dropped.fetch_add(events.size(), std::memory_order_relaxed);
+		events.clear();
+		finished = true;
+		condition.notify_all();
+	});
+	return true;
+}
+
+void QueuedSink::post(const OutputEvent & event) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!thread.joinable() || stopping) {return;}
+		if(events.size() >= maxQueued) {
+			events.pop_front();
+			dropped.fetch_add(1, std::memory_order_relaxed);
+		}
+		events.push_back(event);
+	}
+	condition.notify_one();
+}
+
+void QueuedSink::stop(std::chrono::steady_clock::time_point deadline) {
+	if(!thread.joinable()) {return;}
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stopping = true;
+		this->deadline = deadline;
+		condition.notify_all();
+
+		// a write blocked past the deadline gives up within a poll interval
+		if(!condition.wait_until(lock, deadline, [this]() {return finished;})) {
+			cancelled = true;
+		}
+	}
+	thread.join();
+	close();
+}
+
+void QueuedSink::logStats() const {
+	if(failed > 0 || dropped > 0) {
+		ofLogWarning(PACKAGE) << "output " << getName() << ": " << written << " written, "
+		                      << failed << " failed, " << dropped << " dropped";
+	}
+	else {
+		ofLogVerbose(PACKAGE) << "output " << getName() << ": " << written << " written";
+	}
+}
+
+//--------------------------------------------------------------
+bool JsonSink::open() {
+	if(path.empty()) {
+		file = STDOUT_FILENO;
+		return true;
+	}
+	file = ::open(ofToDataPath(path).c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if(file < 0) {
+		ofLogError(PACKAGE) << "output: could not open " << path << ": " << std::strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+bool JsonSink::write(const OutputEvent & event) {
+	std::string line = toJson(event, labels) + "\n";
+	const char *data = line.data();
+	std::size_t remaining = line.size();
+	while(remaining > 0) {
+
+		// wait for room in a pipe or terminal, a write of up to PIPE_BUF
+		// then doesn't block, regular files are always ready
+		struct pollfd fd = {file, POLLOUT, 0};
+		int ready = poll(&fd, 1, pollInterval);
+		if(ready < 0 && errno != EINTR) {return false;}
+		if(ready <= 0) {
+			if(isCancelled()) {return false;}
+			continue;
+		}
+		if(fd.revents & (POLLERR | POLLHUP | POLLNVAL)) {return false;}
+		ssize_t n = ::write(file, data, std::min(remaining, (std::size_t)PIPE_BUF));
+		if(n < 0) {
+			if(errno == EINTR || errno == EAGAIN) {continue;}
+			return false;
+		}
+		data += n;
+		remaining -= n;
+	}
+	return true;
+}
+
+void JsonSink::close() {
+	if(file >= 0 && file != STDOUT_FILENO) {
+		::close(file);
+	}
+	file = -1;
+}
+
+//--------------------------------------------------------------
+bool UnixSocketSink::open() {
+	struct sockaddr_un addr;
+	if(path.size() >= sizeof(addr.sun_path)) {
+		ofLogError(PACKAGE) << "output: unix socket path too long: " << path;
+		return false;
+	}
+	socket = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+	if(socket < 0) {
+		ofLogError(PACKAGE) << "output: could not open unix socket: " << std::strerror(errno);
+		return false;
+	}
+	fcntl(socket, F_SETFD, FD_CLOEXEC); // not for command children
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+	// connect if the consumer is already bound, otherwise reconnect when
+	// sending so the consumer can start later
+	if(connect(socket, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		ofLogVerbose(PACKAGE) << "output: no consumer bound to " << path << " yet";
+	}
+	return true;
+}
+
+bool UnixSocketSink::write(const OutputEvent & event) {
+	OutputRecord record;
+	std::memset(&record, 0, sizeof(record));
+	std::memcpy(record.magic, "LID1", 4);
+	record.detecting = event.detecting;
+	record.time = event.time;
+	record.index = event.index;
+	record.confidence = event.confidence;
+	std::strncpy(record.label, event.label.c_str(), sizeof(record.label) - 1);
+	record.numScores = (uint32_t)(event.scores.size() < OutputRecord::maxScores ?
+	                              event.scores.size() : OutputRecord::maxScores);
+	std::copy(event.scores.begin(), event.scores.begin() + record.numScores, record.scores);
+	std::size_t size = offsetof(OutputRecord, scores) + record.numScores * sizeof(float);
+
+	struct sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	ssize_t sent = send(socket, &record, size, MSG_DONTWAIT);
+	if(sent < 0 && (errno == ENOTCONN || errno == EDESTADDRREQ || errno == ECONNREFUSED)) {
+		// consumer (re)started, try reconnecting
+		if(connect(socket, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+			sent = send(socket, &record, size, MSG_DONTWAIT);
+		}
+	}
+	return sent == (ssize_t)size;
+}
+
+void UnixSocketSink::close() {
+	if(socket >= 0) {
+		::close(socket);
+		socket = -1;
+	}
+}
+
+//--------------------------------------------------------------
+bool OscSink::start() {
+	output.start();
+	return true;
+}
+
+void OscSink::post(const OutputEvent & event) {
+	if(event.index >= 0) {
+		ofxOscMessage message;
+		message.setAddress("/lang");
+		message.addIntArg(event.index);
+		message.addStringArg(event.label);
+		message.addFloatArg(event.confidence * 100);
+		for(float duration : event.timing) {
+			message.addFloatArg(duration);
+		}
+		output.add(message);
+	}
+	if(event.detecting >= 0) {
+		ofxOscMessage message;
+		message.setAddress("/detecting");
+		message.addIntArg(event.detecting);
+		output.add(message);
+	}
+	output.send();
+}
+
+void OscSink::stop(std::chrono::steady_clock::time_point) {
+	output.stop();
+}
+
+//--------------------------------------------------------------
+BoardSink::BoardSink(const std::string & name, const Labels & labels) :
+	name(name[0] == '/' ? name : "/" + name), labels(labels) {}
+
+bool BoardSink::start() {
+	std::vector<std::string> names;
+	for(auto &label : labels) {
+		if(label.first < 0) {continue;}
+		if((std::size_t)label.first >= names.size()) {names.resize(label.first + 1);}
+		names[label.first] = label.second;
+	}
+	detecting = false;
+	written = 0;
+	return board.open(name, 1, names.data(), names.size());
+}
+
+void BoardSink::post(const OutputEvent & event) {
+	if(event.detecting >= 0) {
+		detecting = (event.detecting == 1);
+	}
+	if(event.index >= 0) {
+		board.publishResult(0, detecting, event.index, event.confidence,
+		                    event.scores.data(), event.scores.size(), event.time);
+	}
+	else {
+		board.publishDetecting(0, detecting, event.time);
+	}
+	written++;
+}
+
+void BoardSink::stop(std::chrono::steady_clock::time_point) {
+	board.close();
+}
+
+void BoardSink::logStats() const {
+	ofLogVerbose(PACKAGE) << "output " << getName() << ": " << written << " written";
+}
@@ -0,0 +1,248 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ClipTiming.h"
+#include "Labels.h"
+#include "OscOutput.h"
+#include "ResultBoard.h"
+
+/// detection output event, detecting status and/or a detection result
+typedef struct OutputEvent {
+	double time = 0;           //< unix time in seconds
+	int detecting = -1;        //< detecting status 1 or 0, -1 if unchanged
+	int index = -1;            //< detected label index, -1 if no result
+	std::string label;         //< detected label name
+	float confidence = 0;      //< detected confidence 0-1
+	std::vector<float> scores; //< confidence 0-1 for each label by index
+	std::vector<float> timing; //< result clip stage durations in ms by ClipTiming::Stage, if enabled
+
+	/// returns true if status or result is set
+	bool isSet() const {return detecting >= 0 || index >= 0;}
+
+	/// clear status & result
+	void clear() {
+		detecting = -1;
+		index = -1;
+		label.clear();
+		confidence = 0;
+		scores.clear();
+		timing.clear();
+	}
+} OutputEvent;
+
+/// binary record datagram sent by the unix socket sink in native byte
+/// order, only the first numScores scores are sent
+typedef struct OutputRecord {
+	static const std::size_t maxScores = 64;
+	char magic[4];         //< "LID1"
+	int32_t detecting;     //< detecting status 1 or 0, -1 if unchanged
+	double time;           //< unix time in seconds
+	int32_t index;         //< detected label index, -1 if no result
+	float confidence;      //< detected confidence 0-1
+	char label[32];        //< detected label name, null terminated
+	uint32_t numScores;    //< number of scores
+	float scores[maxScores]; //< confidence 0-1 for each label by index
+} OutputRecord;
+
+/// detection output destination
+///
+/// post() is called on the main thread and must return right away,
+/// each sink sends or writes in its own background thread
+class OutputSink {
+
+	public:
+
+		virtual ~OutputSink() {}
+
+		/// open output & start background thread, returns true on success
+		virtual bool start() = 0;
+
+		/// post event for output
+		virtual void post(const OutputEvent & event) = 0;
+
+		/// output posted events until deadline, then stop
+		virtual void stop(std::chrono::steady_clock::time_point deadline) = 0;
+
+		/// log output counters
+		virtual void logStats() const = 0;
+
+		/// sink description, ie. "file out.jsonl"
+		virtual std::string getName() const = 0;
+
+		/// check output spec: "osc", "stdout", "unix:PATH", "file:PATH", or
+		/// "shm:NAME", returns true if valid
+		static bool isValid(const std::string & spec);
+
+		/// create sink for output spec with labels by index, osc sinks send
+		/// through output, returns nullptr if the spec is invalid
+		static std::unique_ptr<OutputSink> create(const std::string & spec, const Labels & labels,
+		                                          OscOutput & output);
+
+		/// format event as a single line JSON object without newline
+		static std::string toJson(const OutputEvent & event, const Labels & labels);
+};
+
+/// sink with a bounded event queue drained by a background thread,
+/// the oldest events are dropped when full
+class QueuedSink : public OutputSink {
+
+	public:
+
+		QueuedSink(std::size_t maxQueued=256) : maxQueued(maxQueued) {}
+		virtual ~QueuedSink() {}
+
+		bool start() override;
+		void post(const OutputEvent & event) override;
+		void stop(std::chrono::steady_clock::time_point deadline) override;
+		void logStats() const override;
+
+		std::atomic<uint64_t> written{0}; //< events written
+		std::atomic<uint64_t> failed{0};  //< events which could not be written
+		std::atomic<uint64_t> dropped{0}; //< events dropped when full or on stop
+
+	protected:
+
+		/// open output in the calling thread, returns true on success
+		virtual bool open() = 0;
+
+		/// write event in the background thread, returns true on success
+		virtual bool write(const OutputEvent & event) = 0;
+
+		/// close output after the background thread stopped,
+		/// derived destructors must call stop() first
+		virtual void close() = 0;
+
+		/// returns true once the stop deadline has passed, a write() which
+		/// may block must wait in short intervals & give up when set
+		bool isCancelled() const {return cancelled.load(std::memory_order_relaxed);}
+
+	private:
+
+		std::size_t maxQueued;
+		std::deque<OutputEvent> events; //< guarded by mutex
+		bool stopping = false; //< guarded by mutex
+		bool finished = false; //< background thread done, guarded by mutex
+		std::atomic<bool> cancelled{false}; //< stop deadline passed
+		std::chrono::steady_clock::time_point deadline; //< guarded by mutex
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::thread thread;
+};
+
+/// line-delimited JSON to stdout or appended to a file, written per line,
+/// waits for a full pipe or terminal only until the stop deadline
+class JsonSink : public QueuedSink {
+
+	public:
+
+		/// write to stdout if path is empty, otherwise append to path
+		JsonSink(const std::string & path, const Labels & labels) : path(path), labels(labels) {}
+		~JsonSink() {stop(std::chrono::steady_clock::now());}
+		std::string getName() const override {return (path.empty() ? "stdout" : "file " + path);}
+
+	protected:
+
+		bool open() override;
+		bool write(const OutputEvent & event) override;
+		void close() override;
+
+	private:
+
+		std::string path;
+		Labels labels;
+		int file = -1;
+};
+
+/// OutputRecord datagrams to a UNIX domain datagram socket bound by the
+/// consumer, events are counted as failed while no consumer is bound
+class UnixSocketSink : public QueuedSink {
+
+	public:
+
+		UnixSocketSink(const std::string & path) : path(path) {}
+		~UnixSocketSink() {stop(std::chrono::steady_clock::now());}
+		std::string getName() const override {return "unix " + path;}
+
+	protected:
+
+		bool open() override;
+		bool write(const OutputEvent & event) override;
+		void close() override;
+
+	private:
+
+		std::string path;
+		int socket = -1;
+};
+
+/// /lang & /detecting messages bundled per event through an OscOutput,
+/// which queues & sends in its own thread
+class OscSink : public OutputSink {
+
+	public:
+
+		OscSink(OscOutput & output) : output(output) {}
+
+		bool start() override;
+		void post(const OutputEvent & event) override;
+		void stop(std::chrono::steady_clock::time_point) override;
+		void logStats() const override {output.logStats();}
+		std::string getName() const override {return "osc";}
+
+	private:
+
+		OscOutput & output;
+};
+
+/// latest state published to a shared memory ResultBoard for readers on
+/// the same host, written directly in post() as updates never block
+class BoardSink : public OutputSink {
+
+	public:
+
+		/// shm name, a leading / is added if missing
+		BoardSink(const std::string & name, const Labels & labels);
+
+		bool start() override;
+		void post(const OutputEvent & event) override;
+		void stop(std::chrono::steady_clock::time_point) override;
+		void logStats() const override;
+		std::string getName() const override {return "shm " + name;}
+
+	private:
+
+		std::string name;
+		Labels labels;
+		ResultBoard board;
+		bool detecting = false; //< last detecting status
+		uint64_t written = 0;   //< events published
+};
+
+/// send console logging to stderr, keeps stdout for the stdout sink
+void logToStderr();
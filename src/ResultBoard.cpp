@@ -0,0 +1,247 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#include "ResultBoard.h"
+
+#include <cerrno>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <sys/file.h>
+
+#include "ofMain.h"
+#include "config.h"
+
+const uint32_t ResultBoardData::magicValue;
+const uint32_t ResultBoardData::versionValue;
+const std::size_t ResultBoardData::maxStreams;
+const std::size_t ResultBoardData::maxScores;
+
+//--------------------------------------------------------------
+bool ResultBoard::open(const std::string & name, std::size_t numStreams,
+                       const std::string *labels, std::size_t numLabels) {
+	close();
+	if(numStreams == 0 || numStreams > ResultBoardData::maxStreams) {
+		ofLogError(PACKAGE) << "board: " << numStreams << " streams, 1 to "
+		                    << ResultBoardData::maxStreams << " supported";
+		return false;
+	}
+	bool existed = false;
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if(fd < 0 && errno == EEXIST) {
+		existed = true;
+		fd = shm_open(name.c_str(), O_RDWR, 0);
+	}
+	if(fd < 0) {
+		ofLogError(PACKAGE) << "board: could not open " << name << ": " << std::strerror(errno);
+		return false;
+	}
+
+	// the writer holds an exclusive lock until closing, so a board in use
+	// by a running instance is not taken over, where shm segments can't be
+	// locked a live board can't be told from a stale one
+	if(flock(fd, LOCK_EX | LOCK_NB) != 0 && errno == EWOULDBLOCK) {
+		ofLogError(PACKAGE) << "board: " << name << " is in use by another instance";
+		::close(fd);
+		return false;
+	}
+	if(ftruncate(fd, sizeof(ResultBoardData)) != 0) {
+		ofLogError(PACKAGE) << "board: could not size " << name << ": " << std::strerror(errno);
+		::close(fd);
+		return false;
+	}
+	void *memory = mmap(nullptr, sizeof(ResultBoardData), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(memory == MAP_FAILED) {
+		ofLogError(PACKAGE) << "board: could not map " << name << ": " << std::strerror(errno);
+		::close(fd);
+		return false;
+	}
+	board = (ResultBoardData *)memory;
+	this->fd = fd;
+	this->name = name;
+	if(existed && board->magic.load(std::memory_order_acquire) == ResultBoardData::magicValue) {
+		ofLogWarning(PACKAGE) << "board: reusing " << name << " left by an earlier run";
+	}
+
+	// readers check magic last, so clear it while (re)initializing
+	board->magic.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	numLabels = (numLabels < ResultBoardData::maxScores ? numLabels : ResultBoardData::maxScores);
+	std::memset(board->labels, 0, sizeof(board->labels));
+	for(std::size_t i = 0; i < numLabels; i++) {
+		std::strncpy(board->labels[i], labels[i].c_str(), sizeof(board->labels[i]) - 1);
+	}
+	for(std::size_t i = 0; i < ResultBoardData::maxStreams; i++) {
+		ResultBoardData::Entry & entry = board->streams[i];
+		// a writer which died mid update left the sequence odd
+		entry.seq.store(entry.seq.load(std::memory_order_relaxed) & ~1u, std::memory_order_relaxed);
+		begin(entry);
+		entry.detecting.store(0, std::memory_order_relaxed);
+		entry.index.store(-1, std::memory_order_relaxed);
+		entry.confidence.store(0, std::memory_order_relaxed);
+		entry.time.store(0, std::memory_order_relaxed);
+		entry.sequence.store(0, std::memory_order_relaxed);
+		entry.numScores.store(0, std::memory_order_relaxed);
+		end(entry);
+	}
+	board->version.store(ResultBoardData::versionValue, std::memory_order_relaxed);
+	board->numStreams.store((uint32_t)numStreams, std::memory_order_relaxed);
+	board->numLabels.store((uint32_t)numLabels, std::memory_order_relaxed);
+	board->magic.store(ResultBoardData::magicValue, std::memory_order_release);
+	return true;
+}
+
+void ResultBoard::close() {
+	if(!board) {return;}
+	munmap(board, sizeof(ResultBoardData));
+	shm_unlink(name.c_str());
+	::close(fd); // releases the lock after the name is gone
+	fd = -1;
+	board = nullptr;
+	name = "";
+}
+
+void ResultBoard::publishDetecting(std::size_t stream, bool detecting, double time) {
+	if(!board || stream >= ResultBoardData::maxStreams) {return;}
+	ResultBoardData::Entry & entry = board->streams[stream];
+	begin(entry);
+	entry.detecting.store(detecting, std::memory_order_relaxed);
+	entry.time.store(time, std::memory_order_relaxed);
+	entry.sequence.store(entry.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	end(entry);
+}
+
+void ResultBoard::publishResult(std::size_t stream, bool detecting, int index, float confidence,
+                                const float *scores, std::size_t numScores, double time) {
+	if(!board || stream >= ResultBoardData::maxStreams) {return;}
+	numScores = (numScores < ResultBoardData::maxScores ? numScores : ResultBoardData::maxScores);
+	ResultBoardData::Entry & entry = board->streams[stream];
+	begin(entry);
+	entry.detecting.store(detecting, std::memory_order_relaxed);
+	entry.index.store(index, std::memory_order_relaxed);
+	entry.confidence.store(confidence, std::memory_order_relaxed);
+	entry.time.store(time, std::memory_order_relaxed);
+	entry.sequence.store(entry.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	entry.numScores.store((uint32_t)numScores, std::memory_order_relaxed);
+	for(std::size_t i = 0; i < numScores; i++) {
+		entry.scores[i].store(scores[i], std::memory_order_relaxed);
+	}
+	end(entry);
+}
+
+// odd sequence tells readers to retry, the release fence orders it before
+// the field stores which follow
+void ResultBoard::begin(ResultBoardData::Entry & entry) {
+	entry.seq.store(entry.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+void ResultBoard::end(ResultBoardData::Entry & entry) {
+	entry.seq.store(entry.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+//--------------------------------------------------------------
+bool ResultBoard::benchmark() {
+	const std::string name = "/" + std::string(PACKAGE) + "-bench-" + std::to_string(getpid());
+	const std::size_t numScores = 8;
+	const std::string labels[numScores] = {"a", "b", "c", "d", "e", "f", "g", "h"};
+	const auto duration = std::chrono::milliseconds(500);
+	ResultBoard writer;
+	if(!writer.open(name, 1, labels, numScores)) {
+		return false;
+	}
+
+	// uncontended read latency
+	{
+		ResultBoardReader reader;
+		if(!reader.open(name)) {
+			std::cout << "board: could not open " << name << " for reading" << std::endl;
+			return false;
+		}
+		ResultBoardSnapshot snapshot;
+		const std::size_t count = 1000000;
+		auto start = std::chrono::steady_clock::now();
+		for(std::size_t i = 0; i < count; i++) {
+			reader.read(snapshot);
+		}
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << "board: " << std::fixed << std::setprecision(1) << elapsed.count() / count
+		          << " ns per uncontended read" << std::endl;
+	}
+
+	// one writer publishing as fast as possible against n readers, all
+	// scores are set to the same value per update so readers can tell a
+	// torn copy
+	bool consistent = true;
+	std::cout << std::left << std::setw(10) << "readers" << std::setw(14) << "writes/s"
+	          << std::setw(14) << "reads/s" << std::setw(12) << "retries %"
+	          << std::setw(10) << "failed" << "torn" << std::endl;
+	for(std::size_t numReaders : {1, 2, 4}) {
+		std::atomic<bool> running{true};
+		std::atomic<uint64_t> reads{0}, failed{0}, torn{0};
+		std::atomic<uint64_t> attempts{0};
+		std::vector<std::thread> readers;
+		for(std::size_t r = 0; r < numReaders; r++) {
+			readers.emplace_back([&]() {
+				ResultBoardReader reader;
+				if(!reader.open(name)) {
+					failed.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				ResultBoardSnapshot snapshot;
+				uint64_t count = 0, fails = 0, tears = 0, tries = 0;
+				while(running.load(std::memory_order_relaxed)) {
+					// one attempt at a time to count retries
+					std::size_t n = 1;
+					while(!reader.read(snapshot, 0, 1) && n < 64) {n++;}
+					tries += n;
+					if(n == 64) {fails++; continue;}
+					for(std::size_t s = 0; s < snapshot.numScores; s++) {
+						if(snapshot.scores[s] != snapshot.confidence) {tears++; break;}
+					}
+					count++;
+				}
+				reads.fetch_add(count, std::memory_order_relaxed);
+				failed.fetch_add(fails, std::memory_order_relaxed);
+				torn.fetch_add(tears, std::memory_order_relaxed);
+				attempts.fetch_add(tries, std::memory_order_relaxed);
+			});
+		}
+		uint64_t writes = 0;
+		float scores[numScores];
+		auto start = std::chrono::steady_clock::now();
+		while(std::chrono::steady_clock::now() - start < duration) {
+			for(std::size_t i = 0; i < 1000; i++, writes++) {
+				float value = (float)(writes % 1000) / 1000.0f;
+				std::fill(scores, scores + numScores, value);
+				writer.publishResult(0, true, (int)(writes % numScores), value, scores, numScores, 0);
+			}
+		}
+		running = false;
+		for(auto &thread : readers) {thread.join();}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		double retries = (reads + failed > 0 ?
+			100.0 * (double)(attempts - reads - failed) / (double)attempts : 0);
+		std::cout << std::left << std::setw(10) << numReaders << std::setw(14) << std::setprecision(0)
+		          << writes / elapsed.count() << std::setw(14) << reads / elapsed.count()
+		          << std::setw(12) << std::setprecision(2) << retries << std::setw(10) << failed
+		          << torn << std::endl;
+		consistent = consistent && torn == 0;
+	}
+	std::cout << std::defaultfloat << std::setprecision(6);
+	return consistent;
+}
@@ -0,0 +1,214 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// result board: latest detection state per stream in a POSIX shared memory
+// segment, written by the identifier & read by colocated processes
+//
+// each stream entry is guarded by a seqlock: the single writer makes the
+// sequence odd while writing and even when done, readers copy the entry and
+// retry if the sequence was odd or changed, so readers never block the
+// writer or each other and make no syscalls after opening
+//
+// this header has no other dependencies so consumers can include it as is,
+// link with -lrt on older Linux systems
+
+/// shared memory layout, all fields are lock-free atomics so the segment can
+/// be shared between processes
+typedef struct ResultBoardData {
+
+	static const uint32_t magicValue = 0x4C494442; //< "LIDB"
+	static const uint32_t versionValue = 1;
+	static const std::size_t maxStreams = 16;
+	static const std::size_t maxScores = 64;
+
+	/// latest state for one stream
+	typedef struct Entry {
+		std::atomic<uint32_t> seq;        //< seqlock, odd while writing
+		std::atomic<int32_t> detecting;   //< 1 while recording or inferring, otherwise 0
+		std::atomic<int32_t> index;       //< last detected label index, -1 if none yet
+		std::atomic<float> confidence;    //< last detected confidence 0-1
+		std::atomic<double> time;         //< last update time in unix seconds
+		std::atomic<uint64_t> sequence;   //< updates for this stream, starting at 1
+		std::atomic<uint32_t> numScores;  //< number of scores
+		std::atomic<float> scores[maxScores]; //< last result scores 0-1 by label index
+	} Entry;
+
+	std::atomic<uint32_t> magic;      //< magicValue once initialized
+	std::atomic<uint32_t> version;    //< layout version
+	std::atomic<uint32_t> numStreams; //< used stream entries
+	std::atomic<uint32_t> numLabels;  //< number of labels
+	char labels[maxScores][32];       //< label names by index, written before magic
+	Entry streams[maxStreams];
+} ResultBoardData;
+
+/// consistent copy of one stream entry
+typedef struct ResultBoardSnapshot {
+	int detecting = 0;
+	int index = -1;
+	float confidence = 0;
+	double time = 0;
+	uint64_t sequence = 0; //< 0 if never updated
+	std::size_t numScores = 0;
+	float scores[ResultBoardData::maxScores];
+} ResultBoardSnapshot;
+
+/// result board reader, wait-free: read() gives up after a bounded number
+/// of attempts if the writer keeps updating the entry
+class ResultBoardReader {
+
+	public:
+
+		ResultBoardReader() {}
+		~ResultBoardReader() {close();}
+
+		// non-copyable
+		ResultBoardReader(ResultBoardReader const &) = delete;
+		ResultBoardReader& operator=(const ResultBoardReader &) = delete;
+
+		/// map board by shm name, ie. "/langid", returns true on success
+		bool open(const std::string & name) {
+			close();
+			int fd = shm_open(name.c_str(), O_RDONLY, 0);
+			if(fd < 0) {return false;}
+			struct stat info;
+			if(fstat(fd, &info) != 0 || (std::size_t)info.st_size < sizeof(ResultBoardData)) {
+				::close(fd);
+				return false;
+			}
+			void *memory = mmap(nullptr, sizeof(ResultBoardData), PROT_READ, MAP_SHARED, fd, 0);
+			::close(fd);
+			if(memory == MAP_FAILED) {return false;}
+			board = (const ResultBoardData *)memory;
+			if(board->magic.load(std::memory_order_acquire) != ResultBoardData::magicValue ||
+			   board->version.load(std::memory_order_relaxed) != ResultBoardData::versionValue) {
+				close();
+				return false;
+			}
+			return true;
+		}
+
+		/// unmap board
+		void close() {
+			if(board) {
+				munmap((void *)board, sizeof(ResultBoardData));
+				board = nullptr;
+			}
+		}
+
+		/// returns true if open
+		bool isOpen() const {return board != nullptr;}
+
+		/// number of streams
+		std::size_t getNumStreams() const {
+			return (board ? board->numStreams.load(std::memory_order_relaxed) : 0);
+		}
+
+		/// label name by index or "" if unknown
+		std::string getLabel(int index) const {
+			if(!board || index < 0 || index >= (int)board->numLabels.load(std::memory_order_relaxed)) {
+				return "";
+			}
+			return std::string(board->labels[index], strnlen(board->labels[index], sizeof(board->labels[index])));
+		}
+
+		/// copy stream entry into snapshot, retrying up to attempts times while
+		/// the writer updates it, returns true if the copy is consistent
+		bool read(ResultBoardSnapshot & snapshot, std::size_t stream=0, std::size_t attempts=64) const {
+			if(!board || stream >= ResultBoardData::maxStreams) {return false;}
+			const ResultBoardData::Entry & entry = board->streams[stream];
+			for(std::size_t i = 0; i < attempts; i++) {
+				uint32_t seq = entry.seq.load(std::memory_order_acquire);
+				if(seq & 1) {continue;} // writing
+				snapshot.detecting = entry.detecting.load(std::memory_order_relaxed);
+				snapshot.index = entry.index.load(std::memory_order_relaxed);
+				snapshot.confidence = entry.confidence.load(std::memory_order_relaxed);
+				snapshot.time = entry.time.load(std::memory_order_relaxed);
+				snapshot.sequence = entry.sequence.load(std::memory_order_relaxed);
+				snapshot.numScores = entry.numScores.load(std::memory_order_relaxed);
+				if(snapshot.numScores > ResultBoardData::maxScores) {continue;} // torn
+				for(std::size_t s = 0; s < snapshot.numScores; s++) {
+					snapshot.scores[s] = entry.scores[s].load(std::memory_order_relaxed);
+				}
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if(entry.seq.load(std::memory_order_relaxed) == seq) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+	private:
+
+		const ResultBoardData *board = nullptr;
+};
+
+/// result board writer, single writer per board
+class ResultBoard {
+
+	public:
+
+		ResultBoard() {}
+		~ResultBoard() {close();}
+
+		// non-copyable
+		ResultBoard(ResultBoard const &) = delete;
+		ResultBoard& operator=(const ResultBoard &) = delete;
+
+		/// create or reset board by shm name, ie. "/langid", with stream
+		/// entries & label names, returns false on failure or if the board is
+		/// in use by another writer
+		bool open(const std::string & name, std::size_t numStreams,
+		          const std::string *labels, std::size_t numLabels);
+
+		/// unmap board and remove its name
+		void close();
+
+		/// returns true if open
+		bool isOpen() const {return board != nullptr;}
+
+		/// publish detecting status for a stream, keeps the last result
+		void publishDetecting(std::size_t stream, bool detecting, double time);
+
+		/// publish result & detecting status for a stream
+		void publishResult(std::size_t stream, bool detecting, int index, float confidence,
+		                   const float *scores, std::size_t numScores, double time);
+
+		/// time contended reads & writes between threads on a temporary
+		/// board and print reads/s, writes/s, & retries per reader count,
+		/// returns false if the board could not be created
+		static bool benchmark();
+
+	private:
+
+		/// begin & end seqlock write
+		void begin(ResultBoardData::Entry & entry);
+		void end(ResultBoardData::Entry & entry);
+
+		ResultBoardData *board = nullptr;
+		int fd = -1; //< kept open to hold the writer lock
+		std::string name;
+};
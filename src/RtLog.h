@@ -0,0 +1,158 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "ofMain.h"
+
+/// real-time safe log for the audio thread
+///
+/// post() copies a fixed size record into a preallocated lock-free ring,
+/// without formatting, allocation, or locking, a background thread drains
+/// the ring and formats the records via ofLog
+///
+/// single producer: only one thread, ie. the audio thread, may post
+class RtLog {
+
+	public:
+
+		/// fixed size log record
+		typedef struct Record {
+			ofLogLevel level = OF_LOG_VERBOSE;
+			const char *message = nullptr; //< static string, ie. a literal
+			int64_t value = 0;             //< optional value printed after message
+			bool hasValue = false;
+			std::chrono::steady_clock::time_point time; //< time posted
+		} Record;
+
+		RtLog() {}
+		~RtLog() {stop();}
+
+		// non-copyable
+		RtLog(RtLog const &) = delete;
+		RtLog& operator=(const RtLog &) = delete;
+
+		/// allocate ring with capacity records, rounded up to a power of 2,
+		/// and start drain thread logging to module every interval ms
+		void start(const std::string & module, std::size_t capacity=256, int interval=10) {
+			stop();
+			std::size_t size = 2;
+			while(size < capacity) {size *= 2;}
+			records.reset(new Record[size]);
+			mask = size - 1;
+			head = 0;
+			tail = 0;
+			this->module = module;
+			this->interval = interval;
+			running = true;
+			thread = std::thread([this]() {
+				while(running.load(std::memory_order_acquire)) {
+					drain();
+					std::this_thread::sleep_for(std::chrono::milliseconds(this->interval));
+				}
+				drain();
+			});
+		}
+
+		/// stop drain thread after logging remaining records
+		void stop() {
+			running = false;
+			if(thread.joinable()) {
+				thread.join();
+			}
+		}
+
+		/// post message in the producer thread, message must stay valid,
+		/// ie. a string literal, returns false & counts drop if the ring is full
+		bool post(ofLogLevel level, const char *message) {
+			return post(level, message, 0, false);
+		}
+
+		/// post message with an integer value in the producer thread
+		bool post(ofLogLevel level, const char *message, int64_t value) {
+			return post(level, message, value, true);
+		}
+
+		std::atomic<uint64_t> dropped{0}; //< records dropped when full
+
+	private:
+
+		bool post(ofLogLevel level, const char *message, int64_t value, bool hasValue) {
+			if(!records) {return false;}
+			std::size_t h = head.load(std::memory_order_relaxed);
+			if(h - tail.load(std::memory_order_acquire) > mask) {
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			Record & record = records[h & mask];
+			record.level = level;
+			record.message = message;
+			record.value = value;
+			record.hasValue = hasValue;
+			record.time = std::chrono::steady_clock::now();
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		/// log queued records in the drain thread
+		void drain() {
+			std::size_t t = tail.load(std::memory_order_relaxed);
+			std::size_t h = head.load(std::memory_order_acquire);
+			for(; t != h; t++) {
+				Record record = records[t & mask];
+				tail.store(t + 1, std::memory_order_release);
+				std::string text = record.message;
+				if(record.hasValue) {
+					text += " " + ofToString(record.value);
+				}
+				float delay = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - record.time).count();
+				if(delay >= 100) { // note late records
+					text += " (" + ofToString(delay, 0) + " ms ago)";
+				}
+				log(record.level, text);
+			}
+			uint64_t d = dropped.load(std::memory_order_relaxed);
+			if(d != reportedDropped) {
+				log(OF_LOG_WARNING, "rt log: " + ofToString(d - reportedDropped) + " record(s) dropped");
+				reportedDropped = d;
+			}
+		}
+
+		void log(ofLogLevel level, const std::string & text) {
+			switch(level) {
+				case OF_LOG_VERBOSE: ofLogVerbose(module) << text; break;
+				case OF_LOG_NOTICE: ofLogNotice(module) << text; break;
+				case OF_LOG_WARNING: ofLogWarning(module) << text; break;
+				default: ofLogError(module) << text; break;
+			}
+		}
+
+		std::unique_ptr<Record[]> records;
+		std::size_t mask = 0;
+		std::atomic<std::size_t> head{0}; //< next write, producer only
+		std::atomic<std::size_t> tail{0}; //< next read, drain thread only
+		std::string module;
+		int interval = 10;
+		std::atomic<bool> running{false};
+		std::thread thread;
+		uint64_t reportedDropped = 0; //< drain thread only
+};
@@ -0,0 +1,265 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <queue>
+#include <string>
+
+// reference: the previous single queue pool, one lock & std::function queue
+// shared by all workers
+class SingleQueuePool final {
+
+	public:
+
+		explicit SingleQueuePool(std::size_t nthreads) : workers(nthreads > 0 ? nthreads : 1) {
+			for(auto &t : workers) {
+				t = std::thread([this]() {
+					while(true) {
+						std::unique_lock<std::mutex> lock{mutex};
+						condvar.wait(lock, [&]() {return !enabled || !tasks.empty();});
+						if(!enabled && tasks.empty()) {break;}
+						auto task = std::move(tasks.front());
+						tasks.pop();
+						lock.unlock();
+						task();
+					}
+				});
+			}
+		}
+
+		~SingleQueuePool() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				enabled = false;
+			}
+			condvar.notify_all();
+			for(auto &t : workers) {t.join();}
+		}
+
+		void post(std::function<void()> task) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				tasks.push(std::move(task));
+			}
+			condvar.notify_one();
+		}
+
+	private:
+
+		std::mutex mutex;
+		std::condition_variable condvar;
+		bool enabled = true;
+		std::queue<std::function<void()>> tasks;
+		std::vector<std::thread> workers;
+};
+
+// callable too large for Task's inline storage
+struct LargeCallable {
+	std::atomic<std::size_t> *counter;
+	char payload[Task::inlineSize * 2];
+	void operator()() {
+		counter->fetch_add(1 + (std::size_t)(payload[0] & 0), std::memory_order_relaxed);
+	}
+};
+
+// wait until counter reaches count
+static void waitFor(const std::atomic<std::size_t> &counter, std::size_t count) {
+	while(counter.load(std::memory_order_acquire) < count) {
+		std::this_thread::yield();
+	}
+}
+
+// median of runs in ns per task
+template<typename F>
+static double timeTasks(F func, std::size_t count, std::size_t runs=5) {
+	std::vector<double> times;
+	for(std::size_t r = 0; r < runs; r++) {
+		auto start = std::chrono::steady_clock::now();
+		func();
+		times.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count);
+	}
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+// medians of alternating runs of reference & func in ns per task, so
+// drifting machine load affects both alike
+template<typename R, typename F>
+static void timePair(R refFunc, F func, std::size_t count, std::size_t runs, double &refTime, double &time) {
+	std::vector<double> refTimes, times;
+	for(std::size_t r = 0; r < runs; r++) {
+		refTimes.push_back(timeTasks(refFunc, count, 1));
+		times.push_back(timeTasks(func, count, 1));
+	}
+	std::sort(refTimes.begin(), refTimes.end());
+	std::sort(times.begin(), times.end());
+	refTime = refTimes[runs / 2];
+	time = times[runs / 2];
+}
+
+bool threadPoolBenchmark() {
+	const std::size_t numThreads = std::max(2U, std::thread::hardware_concurrency());
+	const std::size_t count = 100000;
+	bool ok = true;
+	auto report = [&](const std::string &name, double refTime, double time, bool complete) {
+		ok = ok && complete;
+		std::cout << std::left << std::setw(32) << name << std::setw(14) << std::fixed << std::setprecision(1)
+		          << refTime << std::setw(14) << time << std::setprecision(2) << refTime / time << "x"
+		          << (complete ? "" : " LOST TASKS") << std::defaultfloat << std::setprecision(6) << std::endl;
+	};
+
+	// Task storage: construct, move into a deque, & run, single threaded,
+	// against std::function which allocates for larger captures
+	std::cout << "task storage, ns per task" << std::endl;
+	std::cout << std::left << std::setw(32) << "callable" << std::setw(14) << "std::function"
+	          << std::setw(14) << "Task" << "speedup" << std::endl;
+	{
+		std::atomic<std::size_t> counter{0};
+		std::deque<std::function<void()>> functions;
+		std::deque<Task> tasks;
+		auto small = [&counter]() {counter.fetch_add(1, std::memory_order_relaxed);};
+		double refTime = timeTasks([&]() {
+			for(std::size_t i = 0; i < count; i++) {functions.emplace_back(small);}
+			while(!functions.empty()) {functions.front()(); functions.pop_front();}
+		}, count);
+		double time = timeTasks([&]() {
+			for(std::size_t i = 0; i < count; i++) {tasks.emplace_back(small);}
+			while(!tasks.empty()) {tasks.front()(); tasks.pop_front();}
+		}, count);
+		report("inline (8 bytes)", refTime, time, counter == count * 10);
+
+		// 40 bytes: inline in Task, too large for std::function's small buffer
+		counter = 0;
+		std::size_t a = 1, b = 2, c = 3, d = 4;
+		auto medium = [&counter, a, b, c, d]() {counter.fetch_add((a + b + c + d) / 10, std::memory_order_relaxed);};
+		refTime = timeTasks([&]() {
+			for(std::size_t i = 0; i < count; i++) {functions.emplace_back(medium);}
+			while(!functions.empty()) {functions.front()(); functions.pop_front();}
+		}, count);
+		time = timeTasks([&]() {
+			for(std::size_t i = 0; i < count; i++) {tasks.emplace_back(medium);}
+			while(!tasks.empty()) {tasks.front()(); tasks.pop_front();}
+		}, count);
+		report("inline (" + std::to_string(sizeof(medium)) + " bytes)", refTime, time, counter == count * 10);
+
+		counter = 0;
+		LargeCallable large{&counter, {0}};
+		refTime = timeTasks([&]() {
+			for(std::size_t i = 0; i < count; i++) {functions.emplace_back(large);}
+			while(!functions.empty()) {functions.front()(); functions.pop_front();}
+		}, count);
+		time = timeTasks([&]() {
+			for(std::size_t i = 0; i < count; i++) {tasks.emplace_back(large);}
+			while(!tasks.empty()) {tasks.front()(); tasks.pop_front();}
+		}, count);
+		report("heap (" + std::to_string(sizeof(LargeCallable)) + " bytes)", refTime, time, counter == count * 10);
+	}
+
+	// pools: tasks posted from outside, then tasks fanned out from inside
+	// workers where work stealing keeps them on the posting worker's deque
+	std::cout << "pools, " << numThreads << " threads, ns per task" << std::endl;
+	std::cout << std::left << std::setw(32) << "workload" << std::setw(14) << "single queue"
+	          << std::setw(14) << "stealing" << "speedup" << std::endl;
+	{
+		std::atomic<std::size_t> counter{0};
+		SingleQueuePool reference(numThreads);
+		ThreadPool pool(numThreads);
+		const std::size_t runs = 11;
+
+		auto small = [&counter]() {counter.fetch_add(1, std::memory_order_relaxed);};
+		double refTime = 0, time = 0;
+		timePair([&]() {
+			std::size_t target = counter + count;
+			for(std::size_t i = 0; i < count; i++) {reference.post(small);}
+			waitFor(counter, target);
+		}, [&]() {
+			std::size_t target = counter + count;
+			for(std::size_t i = 0; i < count; i++) {pool.post(small);}
+			waitFor(counter, target);
+		}, count, runs, refTime, time);
+		report("post inline", refTime, time, counter == count * runs * 2);
+
+		counter = 0;
+		LargeCallable large{&counter, {0}};
+		timePair([&]() {
+			std::size_t target = counter + count;
+			for(std::size_t i = 0; i < count; i++) {reference.post(large);}
+			waitFor(counter, target);
+		}, [&]() {
+			std::size_t target = counter + count;
+			for(std::size_t i = 0; i < count; i++) {pool.post(large);}
+			waitFor(counter, target);
+		}, count, runs, refTime, time);
+		report("post heap", refTime, time, counter == count * runs * 2);
+
+		// each root task posts its subtasks from its worker
+		counter = 0;
+		const std::size_t roots = 100, fanout = count / roots;
+		timePair([&]() {
+			std::size_t target = counter + count;
+			for(std::size_t r = 0; r < roots; r++) {
+				reference.post([&]() {
+					for(std::size_t i = 0; i < fanout; i++) {reference.post(small);}
+				});
+			}
+			waitFor(counter, target);
+		}, [&]() {
+			std::size_t target = counter + count;
+			for(std::size_t r = 0; r < roots; r++) {
+				pool.post([&]() {
+					for(std::size_t i = 0; i < fanout; i++) {pool.post(small);}
+				});
+			}
+			waitFor(counter, target);
+		}, count, runs, refTime, time);
+		report("fan out from workers", refTime, time, counter == count * runs * 2);
+
+		// futures, the reference wraps a shared promise in its task like
+		// the previous schedule() did
+		counter = 0;
+		const std::size_t futures = count / 10;
+		timePair([&]() {
+			std::vector<std::future<void>> results;
+			results.reserve(futures);
+			for(std::size_t i = 0; i < futures; i++) {
+				auto promise = std::make_shared<std::promise<void>>();
+				results.push_back(promise->get_future());
+				reference.post([promise, &small]() {small(); promise->set_value();});
+			}
+			for(auto &result : results) {result.get();}
+		}, [&]() {
+			std::vector<std::future<void>> results;
+			results.reserve(futures);
+			for(std::size_t i = 0; i < futures; i++) {
+				results.push_back(pool.schedule(small));
+			}
+			for(auto &result : results) {result.get();}
+		}, futures, runs, refTime, time);
+		report("schedule with future", refTime, time, counter == futures * runs * 2);
+
+		// all tasks accounted for on shutdown
+		ThreadPool::Report shutdown = pool.shutdown(std::chrono::steady_clock::now() + std::chrono::seconds(5));
+		bool complete = (shutdown.cancelled == 0);
+		ok = ok && complete;
+		std::cout << "stealing pool: " << shutdown.completed << " task(s) completed, "
+		          << shutdown.cancelled << " cancelled" << std::endl;
+	}
+	return ok;
+}
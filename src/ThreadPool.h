@@ -1,27 +1,211 @@
 // adapted from https://codereview.stackexchange.com/a/229569
 // StackOverflow user KeyC0de 2019
 // updates by SO user673679 2019
+// work stealing, task priorities & draining shutdown by ZKM | Hertz-Lab 2022
 #pragma once
 
-#include <cassert>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstddef>
+#include <exception>
 #include <functional>
 #include <future>
-#include <queue>
+#include <mutex>
+#include <new>
+#include <stdexcept>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-/// simple worker thread pool
+/// error set on the futures of tasks cancelled by ThreadPool::shutdown()
+class TaskCancelled : public std::runtime_error {
+	public:
+		TaskCancelled() : std::runtime_error("task cancelled by thread pool shutdown") {}
+};
+
+/// move-only void() task, small callables are stored inline to avoid the
+/// heap allocation std::function makes, larger ones fall back to the heap
+///
+/// callables with a cancel() method have it called when a task is cancelled
+/// instead of run, others are simply destroyed
+class Task final {
+
+public:
+
+	/// max size of callables stored inline
+	static const std::size_t inlineSize = 64;
+
+	Task() {}
+
+	template<class FuncT, class = typename std::enable_if<
+		!std::is_same<typename std::decay<FuncT>::type, Task>::value>::type>
+	Task(FuncT &&func) {
+		using F = typename std::decay<FuncT>::type;
+		init<F>(std::forward<FuncT>(func), std::integral_constant<bool,
+			sizeof(F) <= inlineSize && alignof(F) <= alignof(std::max_align_t) &&
+			std::is_nothrow_move_constructible<F>::value>());
+	}
+
+	Task(Task &&other) noexcept {take(other);}
+
+	Task& operator=(Task &&other) noexcept {
+		if(this != &other) {
+			clear();
+			take(other);
+		}
+		return *this;
+	}
+
+	~Task() {clear();}
+
+	// non-copyable
+	Task(Task const &) = delete;
+	Task& operator=(const Task &) = delete;
+
+	/// run task
+	void operator()() {ops_->call(&storage_);}
+
+	/// cancel task without running it, clears callable
+	void cancel() {
+		if(ops_) {
+			ops_->cancel(&storage_);
+			clear();
+		}
+	}
+
+	/// returns true if a callable is set
+	explicit operator bool() const {return ops_ != nullptr;}
+
+private:
+
+	/// type erased operations, move & destroy are null for trivially
+	/// copyable & destructible callables which are simply copied
+	struct Ops {
+		void (*call)(void *storage);
+		void (*cancel)(void *storage);
+		void (*move)(void *dst, void *src);
+		void (*destroy)(void *storage);
+	};
+
+	/// does F have a cancel() method?
+	template<class F, class = void>
+	struct IsCancellable : std::false_type {};
+	template<class F>
+	struct IsCancellable<F, decltype(std::declval<F&>().cancel(), void())> : std::true_type {};
+
+	template<class F>
+	static void cancelCallable(F &f, std::true_type) {f.cancel();}
+	template<class F>
+	static void cancelCallable(F &, std::false_type) {}
+
+	template<class F>
+	struct InlineOps {
+		static void call(void *s) {(*static_cast<F*>(s))();}
+		static void cancel(void *s) {cancelCallable(*static_cast<F*>(s), IsCancellable<F>());}
+		static void move(void *dst, void *src) {
+			new(dst) F(std::move(*static_cast<F*>(src)));
+			static_cast<F*>(src)->~F();
+		}
+		static void destroy(void *s) {static_cast<F*>(s)->~F();}
+		static const Ops* ops() {
+			static const Ops o = {&call, &cancel,
+				std::is_trivially_copyable<F>::value ? nullptr : &move,
+				std::is_trivially_destructible<F>::value ? nullptr : &destroy};
+			return &o;
+		}
+	};
+
+	template<class F>
+	struct HeapOps {
+		static void call(void *s) {(**static_cast<F**>(s))();}
+		static void cancel(void *s) {cancelCallable(**static_cast<F**>(s), IsCancellable<F>());}
+		static void move(void *dst, void *src) {*static_cast<F**>(dst) = *static_cast<F**>(src);}
+		static void destroy(void *s) {delete *static_cast<F**>(s);}
+		static const Ops* ops() {
+			static const Ops o = {&call, &cancel, &move, &destroy};
+			return &o;
+		}
+	};
+
+	typename std::aligned_storage<inlineSize, alignof(std::max_align_t)>::type storage_;
+	const Ops *ops_ = nullptr;
+
+	template<class F, class FuncT>
+	void init(FuncT &&func, std::true_type) {
+		new(&storage_) F(std::forward<FuncT>(func));
+		ops_ = InlineOps<F>::ops();
+	}
+
+	template<class F, class FuncT>
+	void init(FuncT &&func, std::false_type) {
+		*reinterpret_cast<F**>(&storage_) = new F(std::forward<FuncT>(func));
+		ops_ = HeapOps<F>::ops();
+	}
+
+	void take(Task &other) {
+		if(other.ops_) {
+			if(other.ops_->move) {
+				other.ops_->move(&storage_, &other.storage_);
+			}
+			else {
+				storage_ = other.storage_;
+			}
+			ops_ = other.ops_;
+			other.ops_ = nullptr;
+		}
+	}
+
+	void clear() {
+		if(ops_) {
+			if(ops_->destroy) {
+				ops_->destroy(&storage_);
+			}
+			ops_ = nullptr;
+		}
+	}
+};
+
+/// work stealing worker thread pool with task priorities
+///
+/// each worker has its own task queues, one per priority, tasks scheduled
+/// from a worker go to its own queues while others are spread round robin,
+/// idle workers steal from the others, highest priority first
+///
+/// pushing & popping only lock the target worker's queues, the pool lock is
+/// only taken to sleep when there is no work or to wake a sleeping worker
+///
+/// shutdown() stops accepting tasks and drains the queued ones until a
+/// deadline, the rest are cancelled: scheduled task futures get a
+/// TaskCancelled error instead of a broken promise
 class ThreadPool final {
 
 public:
 
-	/// constructor with max number of threads
-	explicit ThreadPool(std::size_t nthreads=std::thread::hardware_concurrency())
-		: enabled_(true), pool_(nthreads) {run();}
+	/// task priorities, higher priority tasks are always run first
+	enum Priority {
+		HIGH,
+		NORMAL,
+		LOW,
+		NUM_PRIORITIES
+	};
 
-	~ThreadPool() {wait();}
+	/// shutdown() task counts
+	struct Report {
+		std::size_t completed = 0; //< tasks run over the pool's lifetime
+		std::size_t drained = 0;   //< tasks run while shutting down
+		std::size_t cancelled = 0; //< tasks cancelled or rejected
+	};
+
+	/// constructor with max number of threads and an optional function run
+	/// at the start of each worker thread with its index, ie. to set priority
+	explicit ThreadPool(std::size_t nthreads=std::thread::hardware_concurrency(),
+	                    std::function<void(std::size_t)> init=nullptr)
+		: enabled_(true), workers_(nthreads > 0 ? nthreads : 1) {run(init);}
+
+	/// cancels any queued tasks, use shutdown() first to drain them
+	~ThreadPool() {shutdown(std::chrono::steady_clock::now());}
 
 	// non-copyable
 	ThreadPool(ThreadPool const &) = delete;
@@ -29,71 +213,290 @@ public:
 
 	/// schedule new task to be done in a worker thread
 	/// ex. pool.schedule(somefunc);
-	/// ex. pool.schedule(std::bind(somefunc, arg1, arg2, ...));
+	/// ex. pool.schedule(std::bind(somefunc, arg1, arg2, ...), ThreadPool::HIGH);
 	template<class TaskT>
-	auto schedule(TaskT task) -> std::future<decltype(task())> {
+	auto schedule(TaskT task, Priority priority=NORMAL) -> std::future<decltype(task())> {
 		using ReturnT = decltype(task());
-		auto promise = std::make_shared<std::promise<ReturnT>>();
-		auto result = promise->get_future();
-		auto t = [p = std::move(promise), t = std::move(task)]() mutable {execute(*p, t);};
-		{
-			std::lock_guard<std::mutex> lock(mutex_);
-			tasks_.push(std::move(t));
-		}
-		condvar_.notify_one();
+		Scheduled<ReturnT, TaskT> scheduled{std::promise<ReturnT>(), std::move(task)};
+		auto result = scheduled.promise.get_future();
+		push(Task(std::move(scheduled)), priority);
 		return result;
 	}
 
+	/// post new task to be done in a worker thread without a result future,
+	/// avoids the promise allocation for fire & forget tasks
+	template<class TaskT>
+	void post(TaskT task, Priority priority=NORMAL) {
+		push(Task(std::move(task)), priority);
+	}
+
+	/// stop accepting tasks and run the queued ones until deadline, then
+	/// cancel the rest & join workers, running tasks are not interrupted
+	/// tasks scheduled after shutdown are cancelled right away
+	/// returns task counts, later calls return the same counts
+	Report shutdown(std::chrono::steady_clock::time_point deadline) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		if(!enabled_) {
+			return report_;
+		}
+		enabled_ = false;
+		drainStart_ = completed();
+		condvar_.notify_all();
+		if(!doneCondvar_.wait_until(lock, deadline, [&]() {return running_ == 0;})) {
+			expired_ = true; // workers stop after their current task
+		}
+		lock.unlock();
+		for(auto &w : workers_) {
+			w.thread.join();
+		}
+
+		// cancel leftovers, pushes seeing enabled_ under a worker lock
+		// before this are cancelled here, later ones in push()
+		std::size_t leftover = 0;
+		for(auto &w : workers_) {
+			std::lock_guard<std::mutex> workerLock(w.mutex);
+			for(int priority = 0; priority < NUM_PRIORITIES; priority++) {
+				Task task;
+				while(w.tasks[priority].pop(task)) {
+					task.cancel();
+					leftover++;
+				}
+				w.count[priority] = 0;
+			}
+		}
+
+		lock.lock();
+		cancelled_ += leftover;
+		report_.completed = completed();
+		report_.drained = report_.completed - drainStart_;
+		report_.cancelled = cancelled_;
+		return report_;
+	}
+
+	/// number of worker threads
+	std::size_t size() const {return workers_.size();}
+
 private:
 
-	std::mutex mutex_;
+	/// scheduled task with its result promise
+	template<class ResultT, class TaskT>
+	struct Scheduled {
+		std::promise<ResultT> promise;
+		TaskT task;
+		void operator()() {execute(promise, task);}
+		void cancel() {promise.set_exception(std::make_exception_ptr(TaskCancelled()));}
+	};
+
+	/// growable FIFO ring of tasks, keeps its storage once grown so a
+	/// busy pool doesn't allocate per task block like std::deque
+	class TaskRing {
+		public:
+			bool empty() const {return size_ == 0;}
+			std::size_t size() const {return size_;}
+			void push(Task &&task) {
+				if(size_ == ring_.size()) {
+					grow();
+				}
+				ring_[(head_ + size_) & (ring_.size() - 1)] = std::move(task);
+				size_++;
+			}
+			bool pop(Task &task) {
+				if(size_ == 0) {
+					return false;
+				}
+				task = std::move(ring_[head_]);
+				head_ = (head_ + 1) & (ring_.size() - 1);
+				size_--;
+				return true;
+			}
+		private:
+			void grow() {
+				std::vector<Task> ring(ring_.empty() ? 64 : ring_.size() * 2);
+				for(std::size_t i = 0; i < size_; i++) {
+					ring[i] = std::move(ring_[(head_ + i) & (ring_.size() - 1)]);
+				}
+				ring_.swap(ring);
+				head_ = 0;
+			}
+			std::vector<Task> ring_; // power of 2 size
+			std::size_t head_ = 0;
+			std::size_t size_ = 0;
+	};
+
+	/// worker thread with its own task queues
+	struct Worker {
+		std::mutex mutex; // guards tasks
+		TaskRing tasks[NUM_PRIORITIES];
+		std::atomic<std::size_t> count[NUM_PRIORITIES] = {}; // queue sizes, to skip empty ones unlocked
+		std::atomic<std::size_t> completed{0}; // tasks run, written by this worker only
+		std::thread thread;
+	};
+
+	std::mutex mutex_; // guards sleeping, shutdown, & the counts below
 	std::condition_variable condvar_;
+	std::condition_variable doneCondvar_; // worker exited
 
-	bool enabled_;
-	std::vector<std::thread> pool_;
-	std::queue<std::function<void()>> tasks_;
+	std::atomic<bool> enabled_; // accepting tasks?
+	std::vector<Worker> workers_;
+	std::size_t running_ = 0; // running worker threads
+	std::atomic<bool> expired_{false}; // shutdown deadline passed
+	std::atomic<std::size_t> next_{0};    // round robin worker for outside tasks
+	std::atomic<std::size_t> idle_{0};    // workers sleeping or about to & not yet woken
+	std::size_t woken_ = 0; // wakeups whose idle count a push took, guarded by mutex_
+	std::size_t cancelled_ = 0; // tasks cancelled or rejected, guarded by mutex_
+	std::size_t drainStart_ = 0; // completed count when shutdown started
+	Report report_;
 
 	template<class ResultT, class TaskT>
 	static void execute(std::promise<ResultT> &p, TaskT &task) {
-		p.set_value(task());
+		try {
+			p.set_value(task());
+		}
+		catch(...) {
+			p.set_exception(std::current_exception());
+		}
 	}
 
 	template<class TaskT>
 	static void execute(std::promise<void> &p, TaskT &task) {
-		task();
-		p.set_value();
+		try {
+			task();
+			p.set_value();
+		}
+		catch(...) {
+			p.set_exception(std::current_exception());
+		}
+	}
+
+	/// pool & worker index of the calling thread, if it is a worker
+	static std::pair<const ThreadPool*, std::size_t>& current() {
+		static thread_local std::pair<const ThreadPool*, std::size_t> worker{nullptr, 0};
+		return worker;
+	}
+
+	/// returns true if any worker has queued tasks
+	bool pending() const {
+		for(auto &w : workers_) {
+			for(auto &count : w.count) {
+				if(count > 0) {return true;}
+			}
+		}
+		return false;
 	}
 
-	void wait() {
+	/// tasks run by all workers
+	std::size_t completed() const {
+		std::size_t count = 0;
+		for(auto &w : workers_) {
+			count += w.completed.load(std::memory_order_relaxed);
+		}
+		return count;
+	}
+
+	void push(Task &&task, Priority priority) {
+		// round robin from outside workers, a racy increment only skews the spread
+		auto &worker = current();
+		std::size_t index = worker.second;
+		if(worker.first != this) {
+			index = next_.load(std::memory_order_relaxed);
+			next_.store(index + 1, std::memory_order_relaxed);
+			index %= workers_.size();
+		}
+		Worker &target = workers_[index];
 		{
-			std::lock_guard<std::mutex> lock(mutex_);
-			enabled_ = false;
+			// check under the worker lock so shutdown's leftover pass sees
+			// any task queued before it disabled the pool
+			std::unique_lock<std::mutex> lock(target.mutex);
+			if(!enabled_) {
+				lock.unlock();
+				task.cancel();
+				std::lock_guard<std::mutex> poolLock(mutex_);
+				cancelled_++;
+				return;
+			}
+			target.tasks[priority].push(std::move(task));
+			target.count[priority]++;
 		}
-		condvar_.notify_all();
-		for(auto &t : pool_) {
-			t.join();
+
+		// a worker going to sleep counts itself idle before checking the queue
+		// counts, so either it sees this task or this sees it & wakes it, taking the
+		// idle count so later pushes don't also lock to wake the same worker
+		if(idle_ > 0) {
+			std::unique_lock<std::mutex> lock(mutex_);
+			if(idle_ > 0) {
+				idle_--;
+				woken_++;
+				lock.unlock();
+				condvar_.notify_one();
+			}
 		}
 	}
 
-	void run() {
-		auto f = [this]() {
-			while(true) {
-				std::unique_lock<std::mutex> lock{mutex_};
-				condvar_.wait(lock, [&]() {
-					return !enabled_ || !tasks_.empty();
-				});
-				if(!enabled_) {
-					break;
+	/// pop task, own queue first then steal from the others, skipping
+	/// empty queues without locking
+	bool pop(std::size_t index, Task &task) {
+		for(int priority = 0; priority < NUM_PRIORITIES; priority++) {
+			for(std::size_t i = 0; i < workers_.size(); i++) {
+				Worker &worker = workers_[(index + i) % workers_.size()];
+				if(worker.count[priority].load(std::memory_order_relaxed) == 0) {
+					continue;
+				}
+				std::lock_guard<std::mutex> lock(worker.mutex);
+				auto &tasks = worker.tasks[priority];
+				if(tasks.pop(task)) {
+					worker.count[priority].store(tasks.size(), std::memory_order_relaxed);
+					return true;
 				}
-				assert(!tasks_.empty());
-				auto task = std::move(tasks_.front());
-				tasks_.pop();
-				lock.unlock();
-				task();
 			}
-		};
-		for(auto &t : pool_) {
-			t = std::thread(f);
+		}
+		return false;
+	}
+
+	void run(std::function<void(std::size_t)> init) {
+		running_ = workers_.size();
+		for(std::size_t i = 0; i < workers_.size(); i++) {
+			workers_[i].thread = std::thread([this, i, init]() {
+				current() = {this, i};
+				if(init) {
+					init(i);
+				}
+				Worker &self = workers_[i];
+				while(!expired_) {
+					Task task;
+					if(pop(i, task)) {
+						task();
+						self.completed.store(self.completed.load(std::memory_order_relaxed) + 1,
+						                     std::memory_order_relaxed);
+						continue;
+					}
+					std::unique_lock<std::mutex> lock{mutex_};
+					// count as idle for each wait, a wakeup may find the
+					// task already stolen
+					while(enabled_ && !pending()) {
+						idle_++;
+						if(enabled_ && !pending()) {
+							condvar_.wait(lock);
+						}
+						if(woken_ > 0) {
+							woken_--; // idle count already taken by a push
+						}
+						else {
+							idle_--;
+						}
+					}
+					if(!enabled_ && !pending()) {
+						break; // drained
+					}
+				}
+				std::lock_guard<std::mutex> lock(mutex_);
+				running_--;
+				doneCondvar_.notify_all();
+			});
 		}
 	}
 };
+
+/// time Task inline & heap storage against std::function and the work
+/// stealing pool against a single queue pool, print results,
+/// returns false if any task was lost
+bool threadPoolBenchmark();
@@ -0,0 +1,162 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#include "ThreadSettings.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+
+#ifdef __linux__
+	#include <sys/resource.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+#if defined(__SSE__) || defined(_M_X64)
+	#include <xmmintrin.h>
+#endif
+
+ThreadStatus applyThreadSettings(const ThreadSettings &settings) {
+	ThreadStatus status;
+
+	// pin to cores
+	if(!settings.cores.empty()) {
+	#ifdef __linux__
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for(auto core : settings.cores) {
+			if(core >= 0 && core < CPU_SETSIZE) {
+				CPU_SET(core, &set);
+			}
+		}
+		status.cores = (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 1 : -1);
+	#else
+		status.cores = -1;
+	#endif
+	}
+
+	// real-time priority, usually requires CAP_SYS_NICE or an rtprio limit
+	if(settings.fifo > 0) {
+		struct sched_param param;
+		param.sched_priority = std::max(sched_get_priority_min(SCHED_FIFO),
+		                       std::min(settings.fifo, sched_get_priority_max(SCHED_FIFO)));
+		status.fifo = (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0 ? 1 : -1);
+	}
+
+	// nice level, per thread on linux, lowering requires privileges
+	if(settings.nice != 0) {
+	#ifdef __linux__
+		status.nice = (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), settings.nice) == 0 ? 1 : -1);
+	#else
+		status.nice = -1;
+	#endif
+	}
+
+	if(settings.flushDenormals) {
+		status.denormals = (flushDenormals() ? 1 : -1);
+	}
+
+	return status;
+}
+
+bool flushDenormals() {
+#if defined(__SSE__) || defined(_M_X64)
+	// FTZ bit 15, DAZ bit 6
+	_mm_setcsr(_mm_getcsr() | 0x8040);
+	return true;
+#elif defined(__aarch64__)
+	// FZ bit 24 in FPCR, covers both inputs & outputs
+	uint64_t fpcr;
+	__asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+	__asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr | (1 << 24)));
+	return true;
+#else
+	return false;
+#endif
+}
+
+std::string describeThreadSettings(const ThreadSettings &settings, const ThreadStatus &status) {
+	std::ostringstream stream;
+	auto result = [&stream](int applied) {
+		if(applied < 0) {stream << " (failed)";}
+	};
+	if(!settings.cores.empty()) {
+		stream << "cores ";
+		for(std::size_t i = 0; i < settings.cores.size(); i++) {
+			stream << (i > 0 ? "," : "") << settings.cores[i];
+		}
+		result(status.cores);
+		stream << " ";
+	}
+	if(settings.fifo > 0) {
+		stream << "fifo " << settings.fifo;
+		result(status.fifo);
+		stream << " ";
+	}
+	if(settings.nice != 0) {
+		stream << "nice " << settings.nice;
+		result(status.nice);
+		stream << " ";
+	}
+	if(settings.flushDenormals) {
+		stream << "denormals flushed";
+		result(status.denormals);
+		stream << " ";
+	}
+	std::string description = stream.str();
+	if(description.empty()) {
+		return "default";
+	}
+	description.pop_back();
+	return description;
+}
+
+bool parseCores(const std::string &list, std::vector<int> &cores) {
+	std::istringstream stream(list);
+	std::string range;
+	std::vector<int> parsed;
+	while(std::getline(stream, range, ',')) {
+		std::size_t dash = range.find('-');
+		try {
+			if(dash == std::string::npos) {
+				parsed.push_back(std::stoi(range));
+			}
+			else {
+				int first = std::stoi(range.substr(0, dash));
+				int last = std::stoi(range.substr(dash + 1));
+				if(first < 0 || last < first) {
+					return false;
+				}
+				for(int core = first; core <= last; core++) {
+					parsed.push_back(core);
+				}
+			}
+		}
+		catch(...) {
+			return false;
+		}
+		if(parsed.back() < 0) {
+			return false;
+		}
+	}
+	if(parsed.empty()) {
+		return false;
+	}
+	cores = parsed;
+	return true;
+}
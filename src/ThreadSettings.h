@@ -0,0 +1,52 @@
+/*
+ * Language Identifier
+ *
+ * Copyright (c) 2021 ZKM | Hertz-Lab
+ * Paul Bethge <bethge@zkm.de>
+ * Dan Wilcox <dan.wilcox@zkm.de>
+ *
+ * BSD Simplified License.
+ * For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ *
+ * This code has been developed at ZKM | Hertz-Lab as part of „The Intelligent
+ * Museum“ generously funded by the German Federal Cultural Foundation.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+/// pipeline thread scheduling settings, applied by the thread itself
+typedef struct ThreadSettings {
+	std::vector<int> cores;      //< cpu cores to pin to, empty for any
+	int fifo = 0;                //< SCHED_FIFO priority 1-99, 0 for default scheduling
+	int nice = 0;                //< nice level -20 to 19, 0 to leave as is
+	bool flushDenormals = false; //< flush denormal floats to zero (FTZ/DAZ)
+} ThreadSettings;
+
+/// applied thread settings, each is 1 if applied, -1 if failed,
+/// or 0 if not requested
+typedef struct ThreadStatus {
+	int cores = 0;
+	int fifo = 0;
+	int nice = 0;
+	int denormals = 0;
+} ThreadStatus;
+
+/// apply settings to the calling thread, makes no allocations so it can be
+/// called from the audio thread, pinning is not supported on macOS and nice
+/// levels are per process there so both are reported as failed
+ThreadStatus applyThreadSettings(const ThreadSettings &settings);
+
+/// enable flush denormals to zero & denormals are zero for the calling
+/// thread, returns false if not supported on this cpu
+bool flushDenormals();
+
+/// describe settings & applied status for logging,
+/// ie. "cores 0,1 fifo 80 (failed) denormals flushed"
+std::string describeThreadSettings(const ThreadSettings &settings, const ThreadStatus &status);
+
+/// parse core list ie. "0,2" or "0-3", returns true on success
+bool parseCores(const std::string &list, std::vector<int> &cores);
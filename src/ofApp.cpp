@@ -15,13 +15,74 @@
 
 #include "ofApp.h"
 #include "ThreadPool.h"
+#include "Autotuner.h"
+#include "AllocCheck.h"
+#include "Dsp.h"
 
 const std::size_t ofApp::modelSampleRate = 16000;
 
-// command worker task
-void executeCommand(std::string command) {
+// process start time for startup timing, set during static initialization
+static const auto startTime = std::chrono::steady_clock::now();
+
+// milliseconds since process start
+static float msSinceStart() {
+	return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// max clip slots when sized automatically from the queue & replicas
+static const std::size_t maxSlots = 64;
+
+// min idle seconds before a rising volume triggers a keep warm inference
+static const float preWarmIdle = 10;
+
+// idle seconds without clips after which an inference is reported as the
+// first after an idle period, to compare cold & warm latency
+static const float coldIdle = 60;
+
+// command worker task, recorded is the clip's recording complete time
+void executeCommand(std::string command, ClipTiming::Time recorded) {
 	ofLogVerbose(PACKAGE) << command;
+	auto start = std::chrono::steady_clock::now();
 	ofSystem(command);
+	ofLogVerbose(PACKAGE) << "command ran in " << ofToString(ClipTiming::between(start, std::chrono::steady_clock::now()), 1)
+	                      << " ms, finished " << ofToString(ClipTiming::between(recorded, std::chrono::steady_clock::now()), 1)
+	                      << " ms after recording";
+}
+
+// per inference thread scratch space, reserved when the thread starts
+// so classifying makes no allocations
+typedef struct InferenceScratch {
+	std::vector<Clip> queued;
+	std::vector<const ClipBuffer*> clips;
+	std::vector<int> argMax;
+	std::vector<float> prob;
+	std::vector<std::vector<float>*> outputVectors;
+	std::size_t worker = 0; //< inference thread index, for histogram shards
+	void reserve(std::size_t batchSize) {
+		queued.reserve(batchSize);
+		clips.reserve(batchSize);
+		argMax.reserve(batchSize);
+		prob.reserve(batchSize);
+		outputVectors.reserve(batchSize);
+	}
+	void clear() {
+		queued.clear();
+		clips.clear();
+		outputVectors.clear();
+	}
+} InferenceScratch;
+static thread_local InferenceScratch scratch;
+
+// apply thread settings in a pool worker thread and log result
+static void applyWorkerSettings(const std::string &name, std::size_t index, const ThreadSettings &settings) {
+	ThreadStatus status = applyThreadSettings(settings);
+	std::string description = describeThreadSettings(settings, status);
+	if(status.cores < 0 || status.fifo < 0 || status.nice < 0) {
+		ofLogWarning(PACKAGE) << name << " thread " << index << ": " << description;
+	}
+	else {
+		ofLogVerbose(PACKAGE) << name << " thread " << index << ": " << description;
+	}
 }
 
 //--------------------------------------------------------------
@@ -38,17 +99,125 @@ void ofApp::setup() {
 	#else
 		std::string modelName = "model_7lang";  // model v2
 	#endif
-	if(!model.load(modelName)) {
+	inputSize = modelSampleRate * inputSeconds;
+	if(autotune != "") {
+		// use cached result or time warm up inference, thread counts are tried
+		// up to each replica's share of the cores unless set explicitly,
+		// the cache key includes every setting which changes the timings
+		Autotuner tuner;
+		Autotuner::Objective objective = Autotuner::LATENCY;
+		Autotuner::parseObjective(autotune, objective);
+		tuner.fixedThreads = sessionSettings.intraOpThreads;
+		int maxThreads = std::max(1U, std::thread::hardware_concurrency() / (unsigned int)replicas);
+		std::string modelHash;
+		bool cached = hashModel(ofToDataPath(modelName, true), modelHash);
+		if(!cached) {
+			ofLogWarning(PACKAGE) << "autotune: could not read model files, result will not be cached";
+		}
+		std::string key = modelHash + "-" + autotune + "-" +
+		                  ofToString(maxThreads) + "x" + ofToString(replicas) + "-" +
+		                  "intra" + ofToString(sessionSettings.intraOpThreads) + "-" +
+		                  "inter" + ofToString(sessionSettings.interOpThreads) + "-" +
+		                  (sessionSettings.spinWait ? "spin" : "nospin");
+		std::string cacheFile = ofToDataPath("autotune.txt", true);
+		Autotuner::Result result;
+		if(cached && Autotuner::load(cacheFile, key, result)) {
+			ofLogNotice(PACKAGE) << "autotune: using cached result for " << autotune;
+		}
+		else {
+			ofLogNotice(PACKAGE) << "autotune: tuning for " << autotune << "...";
+			if(tuner.tune(ofToDataPath(modelName, true), sessionSettings, inputSize,
+			              maxThreads, objective, result)) {
+				if(cached && !Autotuner::save(cacheFile, key, result)) {
+					ofLogWarning(PACKAGE) << "autotune: could not save " << cacheFile;
+				}
+			}
+			else {
+				ofLogWarning(PACKAGE) << "autotune: failed, using defaults";
+				result = Autotuner::Result();
+			}
+		}
+		if(result.threads > 0) {
+			sessionSettings.intraOpThreads = result.threads;
+			sessionSettings.perSessionThreads = true;
+			batchSize = result.batchSize;
+			ofLogNotice(PACKAGE) << "autotune: " << result.threads << " thread(s) batch " << result.batchSize
+			                     << " (" << ofToString(result.latency, 1) << " ms, "
+			                     << ofToString(result.throughput, 1) << " clips/s)";
+		}
+	}
+	if(replicas > 1) {
+		// split cores between replicas, each with their own pools as the
+		// process-wide pools are sized by whichever session is created first
+		if(sessionSettings.intraOpThreads == 0) {
+			sessionSettings.intraOpThreads = std::max(1U, std::thread::hardware_concurrency() / (unsigned int)replicas);
+		}
+		sessionSettings.perSessionThreads = true;
+	}
+	if(graphCacheDir != "") {
+		GraphCache cache;
+		if(cache.setup(ofToDataPath(graphCacheDir, true), ofToDataPath(modelName, true))) {
+			sessionSettings.cacheDir = cache.path;
+			ofLogNotice(PACKAGE) << "graph cache: " << cache.path
+			                     << (cache.isWarm() ? " (warm)" : " (cold)");
+			if(!sessionSettings.globalJit) {
+				ofLogVerbose(PACKAGE) << "graph cache: only parts the model marks for compilation are cached, "
+				                      << "use --jit to cache the whole graph";
+			}
+		}
+	}
+	if(sessionSettings.globalJit) {
+		ofLogNotice(PACKAGE) << "xla jit: true";
+	}
+	float loadStart = msSinceStart();
+	if(!model.load(modelName, sessionSettings, replicas)) {
 		std::exit(EXIT_FAILURE);
 	}
+	ofLogNotice(PACKAGE) << model.getNumReplicas() << " model replica(s) with "
+	                     << (sessionSettings.intraOpThreads > 0 ? ofToString(sessionSettings.intraOpThreads) : "default")
+	                     << " intra-op & "
+	                     << (sessionSettings.interOpThreads > 0 ? ofToString(sessionSettings.interOpThreads) : "default")
+	                     << " inter-op thread(s) each";
+	ofLogNotice(PACKAGE) << "model thread pools: " << (sessionSettings.perSessionThreads ? "per session" : "shared")
+	                     << ", spin wait: " << (sessionSettings.spinWait ? "true" : "false");
+	modelLoadTime = msSinceStart() - loadStart;
+	ofLogNotice(PACKAGE) << "startup: model loaded in " << ofToString(modelLoadTime, 1) << " ms";
 
 	// recording settings
 	numBuffers = sampleRate * inputSeconds / bufferSize;
-	previousBuffers.setMaxLen(numPreviousBuffers);
-	sampleBuffers.setMaxLen(numBuffers);
+	CaptureFormat format;
+	CaptureFormat::parse(captureFormat, downsamplingFactor, format);
+	// every queued clip holds a slot, so the queue can only fill with slots
+	// for a full queue, the clips being inferred, and one recording, else
+	// overload shows up as missed triggers instead of dropped clips
+	std::size_t queueSlots = queueSize + model.getNumReplicas() + 1;
+	if(queueSlots > maxSlots) {
+		std::size_t maxQueue = maxSlots - std::min(model.getNumReplicas() + 1, maxSlots - 1);
+		ofLogWarning(PACKAGE) << "clip queue: " << queueSize << " clip(s) can't fill with at most "
+		                      << maxSlots << " slots, using " << maxQueue;
+		queueSize = maxQueue;
+		queueSlots = queueSize + model.getNumReplicas() + 1;
+	}
+	if(numSlots == 0) {
+		numSlots = std::min(queueSlots, maxSlots);
+	}
+	if(numSlots < queueSlots) {
+		ofLogWarning(PACKAGE) << "clip queue: " << numSlots << " slot(s) can't fill a queue of " << queueSize
+		                      << " with " << model.getNumReplicas() << " replica(s), "
+		                      << queueSlots << " needed, overload is counted as missed triggers";
+	}
+	detector.setup(numPreviousBuffers, numBuffers, bufferSize, numSlots, format);
 	ofLogVerbose(PACKAGE) << "Looking " << std::to_string(numPreviousBuffers) << " into the past"
 					<< " and recording a total of " << std::to_string(numBuffers) << " buffers"
-					<< " each with " << std::to_string(bufferSize) << " samples"; 
+					<< " each with " << std::to_string(bufferSize) << " samples"
+					<< " into " << std::to_string(detector.getNumSlots()) << " slot(s)";
+	ofLogNotice(PACKAGE) << "capture: " << captureFormat << ", "
+	                     << ofToString(detector.getMemorySize() / 1024.0f, 0) << " kB per stream";
+	ofLogVerbose(PACKAGE) << "dsp: " << dsp().name;
+
+	// audio thread logging, formatted in the background
+	audioLog.start(PACKAGE);
+	audioThread.flushDenormals = true;
 
 	// apply settings to soundStream
 	ofSoundStreamSettings settings;
@@ -89,6 +258,7 @@ void ofApp::setup() {
 		std::exit(EXIT_FAILURE);
 	}
 	monoBuffer.resize(bufferSize);
+	callbackInterval = bufferSize * 1000.0f / sampleRate;
 	if(!listening) {
 		soundStream.stop();
 	}
@@ -106,21 +276,99 @@ void ofApp::setup() {
 	}
 	ofLogVerbose(PACKAGE) << "<---- detected languages";
 
+	// preallocate per-clip memory so the steady state makes no allocations
+	model.reserve(inputSize, batchSize);
+	slotResults.resize(detector.getNumSlots());
+	for(auto & result : slotResults) {
+		result.outputVector.reserve(AudioClassifier::maxClasses);
+	}
+	finishedSlots.reserve(detector.getNumSlots());
+
+	// per label result counters, label names are copied for the metrics
+	// server thread
+	for(const auto & label : labelsMap) {
+		if(label.first < 0) {continue;}
+		if(label.first >= (int)metricsLabels.size()) {
+			metricsLabels.resize(label.first + 1);
+		}
+		metricsLabels[label.first] = label.second;
+		if(label.second == "noise") {
+			noiseIndex = label.first;
+		}
+	}
+	detections.reset(new std::atomic<uint64_t>[metricsLabels.size()]);
+	for(std::size_t i = 0; i < metricsLabels.size(); i++) {
+		detections[i].store(0, std::memory_order_relaxed);
+	}
+
 	// warm up: inital inference involves initalization (takes longer)
-	auto test = cppflow::fill({1, 80000, 1}, 1.0f);
-	output = model.runModel(test);
+	float warmUpStart = msSinceStart();
+	model.warmUp(inputSize);
+	ofLogNotice(PACKAGE) << "startup: warm up in " << ofToString(msSinceStart() - warmUpStart, 1) << " ms, "
+	                     << "ready for inference " << ofToString(msSinceStart(), 1) << " ms after start";
+	lastInference = msSinceStart() / 1000.0f;
+	lastClip = lastInference;
+
+	// keep audio & model buffers in RAM, the warm up paged them in, the
+	// weights are only covered by locking all memory
+	if(lockMemory) {
+		detector.lock(memoryLock);
+		memoryLock.lock(monoBuffer.data(), monoBuffer.size() * sizeof(float));
+		model.lock(memoryLock);
+		if(memoryLock.failed > 0) {
+			ofLogWarning(PACKAGE) << "memory lock: " << memoryLock.failed << " buffer(s) could not be locked";
+		}
+		if(lockAllMemory) {
+			if(memoryLock.lockAll()) {
+				ofLogNotice(PACKAGE) << "memory lock: " << ofToString(memoryLock.getLockedBytes() / 1048576.0f, 1)
+				                     << " MB locked, all process memory";
+			}
+			else {
+				std::size_t limit = MemoryLock::getLimit();
+				ofLogWarning(PACKAGE) << "memory lock: could not lock all process memory, RLIMIT_MEMLOCK is "
+				                      << (limit == SIZE_MAX ? "unlimited" : ofToString(limit / 1024) + " kB");
+			}
+		}
+		if(!memoryLock.isAllLocked()) {
+			ofLogNotice(PACKAGE) << "memory lock: " << ofToString(memoryLock.getLockedBytes() / 1048576.0f, 1)
+			                     << " MB of audio & model buffers locked";
+		}
+	}
+	if(keepWarm > 0) {
+		ofLogNotice(PACKAGE) << "keep warm: after " << keepWarm << " s idle";
+	}
+	if(preWarm) {
+		ofLogNotice(PACKAGE) << "pre warm: true";
+	}
 
-	// osc
-	ofLogNotice(PACKAGE) << hosts.size() << " osc sender host(s)";
-	for(auto host : hosts) {
-		ofxOscSender *sender = new ofxOscSender;
-		if(sender->setup(host.address, host.port)) {
-			senders.push_back(sender);
-			ofLogNotice(PACKAGE) << "  " << host.address << " " << host.port;
+	// outputs, each sends in its own thread
+	for(std::size_t i = 0; i < outputs.size(); i++) {
+		const std::string & spec = outputs[i];
+		if(std::find(outputs.begin(), outputs.begin() + i, spec) != outputs.begin() + i) {
+			continue; // skip duplicates
+		}
+		std::unique_ptr<OutputSink> sink = OutputSink::create(spec, labelsMap, oscOutput);
+		if(!sink) {continue;}
+		if(spec == "osc") {
+			ofLogNotice(PACKAGE) << hosts.size() << " osc sender host(s)";
+			for(auto host : hosts) {
+				oscOutput.addDestination(host.address, host.port);
+				ofLogNotice(PACKAGE) << "  " << host.address << " " << host.port;
+			}
 		}
+		if(!sink->start()) {
+			ofLogError(PACKAGE) << "output " << sink->getName() << " disabled";
+			continue;
+		}
+		if(spec != "osc") {
+			ofLogNotice(PACKAGE) << "output " << sink->getName();
+		}
+		sinks.push_back(std::move(sink));
 	}
 	ofLogNotice(PACKAGE) << "osc receiver port " << port;
-	receiver.setup(port);
+	receiver.start(port, [this](const ofxOscMessage &message) {
+		controlReceived(message);
+	});
 
 	// behavior
 	if(!listening) {
@@ -130,24 +378,77 @@ void ofApp::setup() {
 		ofLogNotice(PACKAGE) << "auto stop: true";
 	}
 
+	// inference runs in the background, one thread per replica,
+	// fed by a bounded queue so overload drops clips instead of adding latency
+	ClipQueue::Policy policy = ClipQueue::DROP_OLDEST;
+	ClipQueue::parsePolicy(queuePolicy, policy);
+	clipQueue.setup(queueSize, policy);
+	ofLogVerbose(PACKAGE) << "clip queue: " << queueSize << " clip(s), drop " << queuePolicy;
+	coalescer.setup(coalesceWindow, keepalive);
+	if(coalescer.isEnabled()) {
+		ofLogVerbose(PACKAGE) << "coalescing detections within " << coalesceWindow << " s, "
+		                      << "keepalive " << keepalive << " s";
+	}
+	inferenceThread.flushDenormals = true;
+	inferenceHistogram.setup(model.getNumReplicas());
+	queueHistogram.setup(model.getNumReplicas());
+	inferencePool = new ThreadPool(model.getNumReplicas(), [this](std::size_t index) {
+		applyWorkerSettings("inference", index, inferenceThread);
+		scratch.reserve(batchSize);
+		scratch.worker = index;
+	});
+
 	// command?
 	if(command != "") {
-		commandPool = new ThreadPool();
+		if(persistent) {
+			// the child inherits the supervisor thread's settings
+			ofLogNotice(PACKAGE) << "persistent command: " << command;
+			commandProcess.start(command, [this]() {
+				applyWorkerSettings("helper", 0, helperThread);
+			});
+		}
+		else {
+			commandPool = new ThreadPool(helperThreads, [this](std::size_t index) {
+				applyWorkerSettings("helper", index, helperThread);
+			});
+		}
+	}
+
+	// metrics are read from counters in the server thread
+	if(metricsPort > 0) {
+		if(metricsServer.start(metricsPort, [this]() {return getMetrics();})) {
+			ofLogNotice(PACKAGE) << "metrics: http://127.0.0.1:" << metricsPort << "/metrics";
+		}
 	}
 
 	ofLogVerbose(PACKAGE) << "setup done";
 	ofLogVerbose(PACKAGE) << "============================";
+
+	// run a clip through the real audio & inference paths
+	if(allocTest) {
+		std::exit(checkAllocations() ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
 }
 
 //--------------------------------------------------------------
 void ofApp::update() {
 
-	// process received osc events
-	while(receiver.hasWaitingMessages()) {
-		ofxOscMessage message;
-		if(receiver.getNextMessage(message)) {
-			oscReceived(message);
+	// audio thread settings applied in the first callback?
+	if(!audioThreadReported && audioThreadApplied.load(std::memory_order_acquire)) {
+		std::string description = describeThreadSettings(audioThread, audioThreadStatus);
+		if(audioThreadStatus.cores < 0 || audioThreadStatus.fifo < 0 || audioThreadStatus.nice < 0) {
+			ofLogWarning(PACKAGE) << "audio thread: " << description;
+		}
+		else {
+			ofLogVerbose(PACKAGE) << "audio thread: " << description;
 		}
+		audioThreadReported = true;
+	}
+
+	// finish received osc events
+	ofxOscMessage message;
+	while(receiver.getNextMessage(message)) {
+		oscReceived(message);
 	}
 
 	// lets scale the vol up to a 0-1 range 
@@ -159,68 +460,50 @@ void ofApp::update() {
 		volHistory.erase(volHistory.begin(), volHistory.begin()+1);
 	}
 
-	if(trigger) {
-		// inference, sets argMax and prob after running model
-		int argMax;
-		float prob;
-		std::vector<float> outputVector;
-		model.classify(sampleBuffers, downsamplingFactor, argMax, prob, outputVector);
-
-		// only send & display label when probabilty is high enough
-		bool detected = false;
-		if(prob >= minConfidence) {
-			displayLabel = labelsMap[argMax];
-
-			// send osc
-			ofxOscMessage message;
-			message.setAddress("/lang");
-			message.addIntArg(argMax);
-			message.addStringArg(displayLabel);
-			message.addFloatArg(prob * 100);
-			for(auto sender: senders) {sender->sendMessage(message);}
-
-			// execute command in worker thread?
-			if(command != "") {
-				std::string exec = command + " selected=" + displayLabel +
-				                   " " + resultToString(outputVector);
-				commandPool->schedule(std::bind(executeCommand, exec));
-			}
+	// recording started?
+	if(detector.takeStarted()) {
+		// detection started
+		outputEvent.detecting = 1;
+		postOutput();
+		blink = true;
+		blinkTimestamp = ofGetElapsedTimef();
+	}
 
-			detected = true;
+	// queue finished recording for an inference thread
+	Clip clip;
+	while(detector.take(clip.buffers, clip.slot)) {
+		clip.stream = inputChannel;
+		detector.getTiming(clip.slot, clip.timing);
+		Clip dropped;
+		if(clipQueue.push(std::move(clip), dropped)) {
+			ofLogVerbose(PACKAGE) << "clip queue full, dropped clip from stream " << dropped.stream;
+			detector.finish(dropped.slot); // dropped clip will not get a result
 		}
-		else {
-			displayLabel = " ";
-		}
-
-		// look up label
-		ofLogVerbose(PACKAGE) << "label: " << labelsMap[argMax];
-		ofLogVerbose(PACKAGE) << "confidence: " << ofToString(prob * 100, 2);
-		ofLogVerbose(PACKAGE) << "============================";
-
-		// release the trigger signal and emit enable
-		trigger = false;
-		enable = true;
-
-		// detection stopped
-		ofxOscMessage message;
-		message.setAddress("/detecting");
-		message.addIntArg(0);
-		for(auto sender: senders) {sender->sendMessage(message);}
+		inferencePool->post([this]() {classifyPending();}, ThreadPool::HIGH);
+	}
 
-		// stop after (successful) detection?
-		if(autostop && detected) {
-			stopListening();
+	// keep model weights in cpu caches & memory while idle
+	if((keepWarm > 0 || preWarm) && !warming &&
+	   detector.getNumBusy() == 0) {
+		float idle = msSinceStart() / 1000.0f - lastInference;
+		bool rising = (preWarm && idle >= preWarmIdle && scaledVol * 100 >= volThreshold * 0.5);
+		if((keepWarm > 0 && idle >= keepWarm) || rising) {
+			warming = true;
+			inferencePool->post([this, idle, rising]() {
+				auto start = std::chrono::steady_clock::now();
+				model.warmUp(inputSize);
+				lastInference = msSinceStart() / 1000.0f;
+				ofLogVerbose(PACKAGE) << (rising ? "pre" : "keep") << " warm after "
+				                      << ofToString(idle, 0) << " s idle: "
+				                      << ofToString(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count(), 1)
+				                      << " ms";
+				warming = false;
+			}, ThreadPool::LOW);
 		}
 	}
 
-	if(recordingStarted) {
-		// detection started
-		ofxOscMessage message;
-		message.setAddress("/detecting");
-		message.addIntArg(1);
-		for(auto sender: senders) {sender->sendMessage(message);}
-		recordingStarted = false;
-	}
+	// process finished inference results
+	processResults();
 }
 
 //--------------------------------------------------------------
@@ -256,7 +539,7 @@ void ofApp::draw() {
 	ofPopStyle();
 
 	// draw recording status
-	if(recording) {
+	if(detector.isRecording()) {
 		if(ofGetElapsedTimef() - blinkTimestamp >= 0.5) {
 			blink = !blink;
 			blinkTimestamp = ofGetElapsedTimef();
@@ -271,75 +554,152 @@ void ofApp::draw() {
 
 //--------------------------------------------------------------
 void ofApp::exit() {
-	ofxOscMessage message;
-	message.setAddress("/detecting");
-	message.addIntArg(0);
-	for(auto sender: senders) {
-		sender->sendMessage(message);
-		delete sender;
+
+	// no more control changes or metrics scrapes while shutting down
+	receiver.stop();
+	metricsServer.stop();
+
+	// finish queued inference & commands until the drain deadline,
+	// so the last detections still get their osc messages & commands
+	auto deadline = std::chrono::steady_clock::now() +
+		std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(drainTimeout));
+	if(inferencePool) {
+		logShutdown("inference", inferencePool->shutdown(deadline));
+		processResults();
+		delete inferencePool;
+		inferencePool = nullptr;
 	}
-	senders.clear();
 	if(commandPool) {
+		logShutdown("command", commandPool->shutdown(deadline));
 		delete commandPool;
 		commandPool = nullptr;
 	}
+	if(persistent && command != "") {
+		std::size_t unwritten = commandProcess.stop(deadline);
+		if(unwritten > 0 || commandProcess.dropped > 0) {
+			ofLogWarning(PACKAGE) << "command shutdown: " << commandProcess.written << " line(s) written, "
+			                      << unwritten << " unwritten, " << commandProcess.dropped << " dropped";
+		}
+		else {
+			ofLogVerbose(PACKAGE) << "command shutdown: " << commandProcess.written << " line(s) written, "
+			                      << commandProcess.restarts << " restart(s)";
+		}
+	}
+
+	outputEvent.detecting = 0;
+	postOutput();
+	for(auto &sink : sinks) {
+		sink->stop(deadline);
+		sink->logStats();
+	}
+	sinks.clear();
+	receiver.logStats();
+	if(!latencies.empty()) {
+		std::sort(latencies.begin(), latencies.end());
+		ofLogVerbose(PACKAGE) << "inference latency over " << latencies.size() << " clip(s) with "
+		                      << model.getNumReplicas() << " replica(s): "
+		                      << "p50 " << ofToString(latencies[latencies.size() / 2], 1) << " ms "
+		                      << "p99 " << ofToString(latencies[latencies.size() * 99 / 100], 1) << " ms";
+	}
+	if(!stageTimes[ClipTiming::TOTAL].empty()) {
+		std::string line;
+		for(int i = 0; i < ClipTiming::NUM_STAGES; i++) {
+			std::vector<float> & times = stageTimes[i];
+			std::sort(times.begin(), times.end());
+			line += std::string(i > 0 ? ", " : "") + ClipTiming::getStageName((ClipTiming::Stage)i) + " " +
+			        ofToString(times[times.size() / 2], 1) + "/" + ofToString(times[times.size() * 99 / 100], 1);
+		}
+		ofLogVerbose(PACKAGE) << "stage timing p50/p99 ms over " << stageTimes[ClipTiming::TOTAL].size()
+		                      << " clip(s): " << line;
+	}
+	for(auto & histogram : getHistograms()) {
+		LatencyHistogram::Summary summary = histogram.second->summarize();
+		if(summary.count == 0) {continue;}
+		ofLogVerbose(PACKAGE) << histogram.first << " histogram ms over " << summary.count << ": "
+		                      << "p50 " << ofToString(summary.p50 / 1000.0f, 2) << " "
+		                      << "p90 " << ofToString(summary.p90 / 1000.0f, 2) << " "
+		                      << "p99 " << ofToString(summary.p99 / 1000.0f, 2) << " "
+		                      << "max " << ofToString(summary.max / 1000.0f, 2);
+	}
+	if(coalescer.isEnabled()) {
+		ofLogVerbose(PACKAGE) << "coalescing: " << coalescer.passed << " detection(s) output, "
+		                      << coalescer.suppressed << " suppressed";
+	}
+	if(detector.missed > 0) {
+		ofLogWarning(PACKAGE) << "detector: " << detector.triggers << " recording(s) started, "
+		                      << detector.missed << " trigger(s) missed with all " << detector.getNumSlots() << " slot(s) busy";
+	}
+	else if(detector.triggers > 0) {
+		ofLogVerbose(PACKAGE) << "detector: " << detector.triggers << " recording(s) started, no missed triggers";
+	}
+	if(clipQueue.pushed > 0) {
+		ofLogVerbose(PACKAGE) << "clip queue: " << clipQueue.pushed << " queued, "
+		                      << clipQueue.dropped << " dropped, " << clipQueue.coalesced << " coalesced, "
+		                      << "wait avg " << ofToString(clipQueue.waitTotal / std::max(clipQueue.popped.load(), (uint64_t)1) / 1000.0f, 1)
+		                      << " ms max " << ofToString(clipQueue.waitMax / 1000.0f, 1) << " ms";
+	}
+	if(xruns > 0) {
+		ofLogWarning(PACKAGE) << "audio: " << xruns << " late callback(s), likely xruns";
+	}
+	else {
+		ofLogVerbose(PACKAGE) << "audio: no late callbacks";
+	}
+	audioLog.stop();
+
+	// unlock while the detector & model buffers are still allocated
+	memoryLock.unlock();
 }
 
 //--------------------------------------------------------------
 void ofApp::audioIn(ofSoundBuffer & input) {
-	// beh, ofSoundBuffer::getNumFrames() actually returns the buffer size?
-	std::size_t numFrames = input.getNumFrames() / input.getNumChannels();
+	AllocCheck::Scope check("audio thread");
 
-	// copy desired channel out of interleaved stream into mono buffer,
-	// assume input stream has enough channels...
-	for(std::size_t i = 0; i < numFrames; i++) {
-		monoBuffer[i] = input[(i*input.getNumChannels())+inputChannel];
+	// apply thread settings once, logged by the main thread
+	if(!audioThreadApplied.load(std::memory_order_relaxed)) {
+		audioThreadStatus = applyThreadSettings(audioThread);
+		audioThreadApplied.store(true, std::memory_order_release);
 	}
 
-	// calculate the root mean square which is a rough way to calculate volume
-	float sumVol = 0.0;
-	for(std::size_t i = 0; i < monoBuffer.size(); i++) {
-		float vol = monoBuffer[i];
-		sumVol += vol * vol;
+	// count callbacks arriving much later than the buffer duration,
+	// the stream drops input when the callback can't keep up
+	auto now = std::chrono::steady_clock::now();
+	if(!audioRestarted.exchange(false, std::memory_order_relaxed)) {
+		float interval = std::chrono::duration<float, std::milli>(now - lastCallback).count();
+		if(interval > callbackInterval * 1.5f) {
+			xruns.fetch_add(1, std::memory_order_relaxed);
+			audioLog.post(OF_LOG_VERBOSE, "late audio callback, ms:", (int64_t)interval);
+		}
 	}
-	curVol = sumVol / (float)monoBuffer.size();
+	lastCallback = now;
+
+	// beh, ofSoundBuffer::getNumFrames() actually returns the buffer size?
+	std::size_t numFrames = input.getNumFrames() / input.getNumChannels();
+
+	// copy desired channel out of interleaved stream into mono buffer
+	// and calculate the root mean square which is a rough way to calculate
+	// volume, assume input stream has enough channels...
+	float sumVol = dsp().deinterleaveSumSquares(input.getBuffer().data(), numFrames,
+		input.getNumChannels(), inputChannel, monoBuffer.data());
+	float curVol = sumVol / (float)monoBuffer.size();
 	curVol = sqrt(curVol);
 	// smooth the volume
-	smoothedVol *= 0.5;
-	smoothedVol += 0.5 * curVol;
-
-	// trigger recording if the smoothed volume is high enough
-	if(ofMap(smoothedVol, 0.0, 0.17, 0.0, 1.0, true) * 100 >= volThreshold && enable) {
-		enable = false;
-		ofLogVerbose(PACKAGE) << "start recording...";
-		// copy previous buffers to the recording
-		sampleBuffers = previousBuffers;
-		sampleBuffers.setMaxLen(numBuffers);		// hacky: last step overwrites maxLen
-		recordingCounter = sampleBuffers.size();	// we already have the previous buffer
-		// trigger recording in the next function call
-		recording = true;
-		recordingStarted = true;
-		blink = true;
-		blinkTimestamp = ofGetElapsedTimef();
-	}
-	// if we didnt just trigger
-	else { 
-		// if recording: save the incoming buffer to the recording
-		// then trigger the neural network
-		if(recording) {
-			sampleBuffers.push(monoBuffer);
-			recordingCounter++;
-			if(recordingCounter >= numBuffers) {
-				recording = false;
-				trigger = true;
-				ofLogVerbose(PACKAGE) << "done!";
-			}
-		}
-		// if not recording: save the incoming buffer to the previous buffer fifo
-		else {
-			previousBuffers.push(monoBuffer);
-		}
+	float vol = smoothedVol.load(std::memory_order_relaxed) * 0.5 + 0.5 * curVol;
+	smoothedVol.store(vol, std::memory_order_relaxed);
+
+	// trigger recording if the smoothed volume is high enough,
+	// then trigger the neural network once the recording is complete
+	switch(detector.process(monoBuffer, ofMap(vol, 0.0, 0.17, 0.0, 1.0, true) * 100 >= volThreshold)) {
+		case Detector::STARTED:
+			audioLog.post(OF_LOG_VERBOSE, "start recording...");
+			break;
+		case Detector::COMPLETED:
+			audioLog.post(OF_LOG_VERBOSE, "done!");
+			break;
+		default:
+			break;
 	}
+	callbackHistogram.record(0, std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - now).count());
 }
 
 //--------------------------------------------------------------
@@ -416,7 +776,9 @@ void ofApp::dragEvent(ofDragInfo dragInfo) {
 
 //--------------------------------------------------------------
 void ofApp::startListening() {
-	enable = true;
+	detector.enable();
+	coalescer.reset();
+	audioRestarted = true;
 	soundStream.start();
 	listening = true;
 	ofLogVerbose(PACKAGE) << "listening " << listening;
@@ -425,19 +787,13 @@ void ofApp::startListening() {
 //--------------------------------------------------------------
 void ofApp::stopListening() {
 	soundStream.stop();
-	previousBuffers.clear();
-	sampleBuffers.clear();
 	smoothedVol = 0;
-	enable = false;
-	if(recording) {
-		recording = false;
+	bool dropped = controlDropped.exchange(false);
+	if(detector.disable() || dropped) {
 		// detection stopped
-		ofxOscMessage message;
-		message.setAddress("/detecting");
-		message.addIntArg(0);
-		for(auto sender: senders) {sender->sendMessage(message);}
+		outputEvent.detecting = 0;
+		postOutput();
 	}
-	trigger = false;
 	listening = false;
 	ofLogVerbose(PACKAGE) << "listening " << listening;
 }
@@ -459,19 +815,22 @@ void ofApp::disableAutostop() {
 }
 
 //--------------------------------------------------------------
-void ofApp::oscReceived(const ofxOscMessage &message) {
+void ofApp::controlReceived(const ofxOscMessage &message) {
+	// the detector & autostop are shared with the audio & main threads,
+	// starting & stopping the audio stream is left to oscReceived()
 	if(message.getAddress() == "/listen") {
 		if(message.getNumArgs() == 0) {
 			if(!listening) {
-				startListening();
+				detector.enable();
 			}
 		}
 		else if(message.getNumArgs() == 1) {
 			if(message.getArgAsBool(0)) {
-				startListening();
+				detector.enable();
 			}
-			else {
-				stopListening();
+			else if(detector.disable()) {
+				// detection stopped, output by stopListening()
+				controlDropped = true;
 			}
 		}
 	}
@@ -488,6 +847,387 @@ void ofApp::oscReceived(const ofxOscMessage &message) {
 			}
 		}
 	}
+	else if(message.getAddress() == "/stats") {
+		// reply right away, histograms are read without blocking writers
+		std::vector<ofxOscMessage> replies;
+		for(auto & histogram : getHistograms()) {
+			LatencyHistogram::Summary summary = histogram.second->summarize();
+			ofxOscMessage reply;
+			reply.setAddress("/stats");
+			reply.addStringArg(histogram.first);
+			reply.addIntArg((int32_t)std::min(summary.count, (uint64_t)INT32_MAX));
+			reply.addFloatArg(summary.p50 / 1000.0f);
+			reply.addFloatArg(summary.p90 / 1000.0f);
+			reply.addFloatArg(summary.p99 / 1000.0f);
+			reply.addFloatArg(summary.max / 1000.0f);
+			replies.push_back(reply);
+		}
+		ofxOscMessage request = message;
+		if(message.getNumArgs() >= 2) {
+			// reply to a different port on the sending host
+			request.setRemoteEndpoint(message.getRemoteHost(), message.getArgAsInt(1));
+		}
+		if(!receiver.reply(request, replies)) {
+			ofLogWarning(PACKAGE) << "could not send stats to " << request.getRemoteHost()
+			                      << ":" << request.getRemotePort();
+		}
+		if(message.getNumArgs() >= 1 && message.getArgAsBool(0)) {
+			for(auto & histogram : getHistograms()) {
+				histogram.second->reset();
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------
+std::vector<std::pair<std::string, LatencyHistogram*>> ofApp::getHistograms() {
+	return {
+		{"inference", &inferenceHistogram},
+		{"queue", &queueHistogram},
+		{"result", &resultHistogram},
+		{"callback", &callbackHistogram}
+	};
+}
+
+//--------------------------------------------------------------
+std::string ofApp::getMetrics() {
+	static const std::string prefix = "languageidentifier_";
+	std::string text;
+	auto header = [&](const std::string & name, const std::string & type, const std::string & help) {
+		text += "# HELP " + prefix + name + " " + help + "\n";
+		text += "# TYPE " + prefix + name + " " + type + "\n";
+	};
+
+	header("triggers_total", "counter", "Recordings started by the volume threshold.");
+	text += metricLine(prefix + "triggers_total", "", detector.triggers.load(std::memory_order_relaxed));
+
+	header("triggers_missed_total", "counter", "Volume triggers refused with all clip slots busy.");
+	text += metricLine(prefix + "triggers_missed_total", "", detector.missed.load(std::memory_order_relaxed));
+
+	header("detections_total", "counter", "Results at or above the min confidence by language.");
+	for(std::size_t i = 0; i < metricsLabels.size(); i++) {
+		if(metricsLabels[i].empty() || (int)i == noiseIndex) {continue;}
+		text += metricLine(prefix + "detections_total", "language=\"" + metricsLabels[i] + "\"",
+		                   detections[i].load(std::memory_order_relaxed));
+	}
+
+	header("rejections_total", "counter", "Results not output as a detection by reason.");
+	text += metricLine(prefix + "rejections_total", "reason=\"noise\"", noiseRejections.load(std::memory_order_relaxed));
+	text += metricLine(prefix + "rejections_total", "reason=\"confidence\"", confidenceRejections.load(std::memory_order_relaxed));
+
+	// cumulative since start, bucket counts round down to the histogram's
+	// own buckets so may lag an exact count by up to 6.25% of the bound
+	static const std::vector<uint64_t> bounds = {
+		100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+		100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+	};
+	static const std::map<std::string, std::string> help = {
+		{"inference", "Model run time per batch."},
+		{"queue", "Clip wait in the inference queue."},
+		{"result", "Trigger to result output time per clip."},
+		{"callback", "Audio callback duration."}
+	};
+	std::vector<uint64_t> counts;
+	for(auto & histogram : getHistograms()) {
+		uint64_t count = 0, sum = 0;
+		histogram.second->totals(bounds, counts, count, sum);
+		std::string name = histogram.first + "_seconds";
+		header(name, "histogram", help.at(histogram.first));
+		for(std::size_t i = 0; i < bounds.size(); i++) {
+			text += metricLine(prefix + name + "_bucket", "le=\"" + ofToString(bounds[i] / 1000000.0) + "\"", counts[i]);
+		}
+		text += metricLine(prefix + name + "_bucket", "le=\"+Inf\"", count);
+		text += metricLine(prefix + name + "_sum", "", sum / 1000000.0);
+		text += metricLine(prefix + name + "_count", "", count);
+	}
+
+	header("queue_depth", "gauge", "Clips waiting for inference.");
+	text += metricLine(prefix + "queue_depth", "", clipQueue.depth.load(std::memory_order_relaxed));
+
+	header("clips_dropped_total", "counter", "Clips dropped before inference by reason.");
+	text += metricLine(prefix + "clips_dropped_total", "reason=\"full\"", clipQueue.dropped.load(std::memory_order_relaxed));
+	text += metricLine(prefix + "clips_dropped_total", "reason=\"coalesced\"", clipQueue.coalesced.load(std::memory_order_relaxed));
+
+	header("xruns_total", "counter", "Late audio callbacks, likely xruns.");
+	text += metricLine(prefix + "xruns_total", "", xruns.load(std::memory_order_relaxed));
+
+	header("osc_send_errors_total", "counter", "OSC bundles which could not be sent by destination.");
+	for(std::size_t i = 0; i < oscOutput.getNumDestinations(); i++) {
+		text += metricLine(prefix + "osc_send_errors_total", "destination=\"" + oscOutput.getDestinationName(i) + "\"",
+		                   oscOutput.getStats(i).failed.load(std::memory_order_relaxed));
+	}
+	header("osc_dropped_total", "counter", "OSC bundles dropped when the send queue was full.");
+	text += metricLine(prefix + "osc_dropped_total", "", oscOutput.dropped.load(std::memory_order_relaxed));
+
+	header("model_load_seconds", "gauge", "Model load time on startup.");
+	text += metricLine(prefix + "model_load_seconds", "", modelLoadTime / 1000.0);
+
+	header("resident_memory_bytes", "gauge", "Resident memory size.");
+	text += metricLine(prefix + "resident_memory_bytes", "", residentMemory());
+	return text;
+}
+
+//--------------------------------------------------------------
+void ofApp::oscReceived(const ofxOscMessage &message) {
+	if(message.getAddress() == "/listen") {
+		if(message.getNumArgs() == 0) {
+			if(!listening) {
+				startListening();
+			}
+		}
+		else if(message.getNumArgs() == 1) {
+			if(message.getArgAsBool(0)) {
+				startListening();
+			}
+			else {
+				stopListening();
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::classifyPending() {
+	AllocCheck::Scope check("inference");
+
+	// take up to batchSize clips, may have been taken by an earlier batch,
+	// results are written to each clip's slot result
+	scratch.clear();
+	if(clipQueue.pop(scratch.queued, batchSize) == 0) {
+		return;
+	}
+	auto start = std::chrono::steady_clock::now();
+	for(auto & clip : scratch.queued) {
+		ClipResult & result = slotResults[clip.slot];
+		result.slot = clip.slot;
+		result.stream = clip.stream;
+		result.wait = std::chrono::duration<float, std::milli>(start - clip.queued).count();
+		result.timing = clip.timing;
+		result.timing.queued = clip.queued;
+		result.timing.started = start;
+		scratch.clips.push_back(clip.buffers);
+		scratch.outputVectors.push_back(&result.outputVector);
+	}
+
+	// inference, sets argMax and prob after running model
+	float idle = msSinceStart() / 1000.0f - lastInference;
+	if(scratch.clips.size() == 1) {
+		ClipResult & result = slotResults[scratch.queued[0].slot];
+		model.classify(*scratch.clips[0], downsamplingFactor, result.argMax, result.prob, result.outputVector,
+		               &result.timing);
+	}
+	else {
+		ClipTiming timing;
+		model.classifyBatch(scratch.clips, downsamplingFactor, scratch.argMax, scratch.prob, scratch.outputVectors,
+		                    &timing);
+		for(std::size_t i = 0; i < scratch.queued.size(); i++) {
+			ClipResult & result = slotResults[scratch.queued[i].slot];
+			result.argMax = scratch.argMax[i];
+			result.prob = scratch.prob[i];
+			result.timing.acquired = timing.acquired;
+			result.timing.prepared = timing.prepared;
+			result.timing.inferred = timing.inferred;
+		}
+	}
+	float latency = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	lastInference = msSinceStart() / 1000.0f;
+	inferenceHistogram.record(scratch.worker, (uint64_t)(latency * 1000));
+	for(auto & clip : scratch.queued) {
+		queueHistogram.record(scratch.worker, std::chrono::duration_cast<std::chrono::microseconds>(start - clip.queued).count());
+	}
+
+	std::lock_guard<std::mutex> lock(resultsMutex);
+	for(auto & clip : scratch.queued) {
+		ClipResult & result = slotResults[clip.slot];
+		result.latency = latency;
+		result.idle = idle;
+		finishedSlots.push_back(clip.slot);
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::processResults() {
+	while(true) {
+		int slot = -1;
+		{
+			std::lock_guard<std::mutex> lock(resultsMutex);
+			if(finishedSlots.empty()) {break;}
+			slot = finishedSlots.front();
+			finishedSlots.erase(finishedSlots.begin());
+		}
+		processResult(slotResults[slot]);
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::processResult(const ClipResult & result) {
+	const int argMax = result.argMax;
+	const float prob = result.prob;
+	ClipTiming timing = result.timing;
+	timing.processed = std::chrono::steady_clock::now();
+
+	// only send & display label when probabilty is high enough
+	bool detected = false;
+	if(prob >= minConfidence) {
+		displayLabel = labelsMap[argMax];
+
+		// output result & run command unless it repeats a recent detection
+		if(coalescer.pass(result.stream, argMax, msSinceStart() / 1000.0f)) {
+			outputEvent.index = argMax;
+			outputEvent.label = displayLabel;
+			outputEvent.confidence = prob;
+			outputEvent.scores = result.outputVector;
+
+			// execute command in worker thread or write to persistent command?
+			if(command != "" && persistent) {
+				commandProcess.post(resultToJson(displayLabel, result.outputVector));
+			}
+			else if(command != "") {
+				std::string exec = command + " selected=" + displayLabel +
+				                   " " + resultToString(result.outputVector);
+				commandPool->post(std::bind(executeCommand, exec, timing.recorded));
+			}
+		}
+		else {
+			ofLogVerbose(PACKAGE) << "repeated detection suppressed";
+		}
+
+		detected = true;
+	}
+	else {
+		displayLabel = " ";
+	}
+	if(argMax == noiseIndex) {
+		noiseRejections.fetch_add(1, std::memory_order_relaxed);
+	}
+	else if(!detected) {
+		confidenceRejections.fetch_add(1, std::memory_order_relaxed);
+	}
+	else if(argMax >= 0 && argMax < (int)metricsLabels.size()) {
+		detections[argMax].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// look up label
+	ofLogVerbose(PACKAGE) << "label: " << labelsMap[argMax];
+	ofLogVerbose(PACKAGE) << "confidence: " << ofToString(prob * 100, 2);
+	ofLogVerbose(PACKAGE) << "queue wait: " << ofToString(result.wait, 1) << " ms";
+	ofLogVerbose(PACKAGE) << "latency: " << ofToString(result.latency, 1) << " ms";
+	timing.output = std::chrono::steady_clock::now();
+	logTiming(timing);
+	resultHistogram.record(0, (uint64_t)(timing.getDuration(ClipTiming::TOTAL) * 1000));
+	if(outputTiming && outputEvent.index >= 0) {
+		outputEvent.timing.resize(ClipTiming::NUM_STAGES);
+		for(int i = 0; i < ClipTiming::NUM_STAGES; i++) {
+			outputEvent.timing[i] = timing.getDuration((ClipTiming::Stage)i);
+		}
+	}
+	ofLogVerbose(PACKAGE) << "============================";
+
+	// first clip after a long quiet period, was the model kept warm?
+	float now = msSinceStart() / 1000.0f;
+	if(now - lastClip >= coldIdle) {
+		ofLogNotice(PACKAGE) << "first inference after " << ofToString(now - lastClip, 0) << " s without clips: "
+		                     << ofToString(result.latency, 1) << " ms, "
+		                     << (result.idle >= coldIdle ? "cold" : "warm") << " model "
+		                     << "(last inference " << ofToString(result.idle, 0) << " s before)";
+	}
+	lastClip = now;
+	if(latencies.size() < 100000) {
+		latencies.push_back(result.latency);
+	}
+
+	// free slot for recording
+	detector.finish(result.slot);
+
+	// detection stopped, unless the next clip is already recording
+	if(detector.getNumBusy() == 0) {
+		outputEvent.detecting = 0;
+	}
+
+	// stop after (successful) detection?
+	if(autostop && detected) {
+		stopListening();
+	}
+
+	// output result & status as one event
+	postOutput();
+}
+
+//--------------------------------------------------------------
+void ofApp::logTiming(const ClipTiming & timing) {
+	std::string line;
+	for(int i = 0; i < ClipTiming::NUM_STAGES; i++) {
+		float duration = timing.getDuration((ClipTiming::Stage)i);
+		line += std::string(i > 0 ? " " : "") + ClipTiming::getStageName((ClipTiming::Stage)i) +
+		        " " + ofToString(duration, 1);
+		if(stageTimes[i].size() < 100000) {
+			stageTimes[i].push_back(duration);
+		}
+	}
+	ofLogVerbose(PACKAGE) << "timing ms: " << line;
+}
+
+//--------------------------------------------------------------
+void ofApp::postOutput() {
+	if(!outputEvent.isSet()) {return;}
+	outputEvent.time = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+	for(auto &sink : sinks) {
+		sink->post(outputEvent);
+	}
+	outputEvent.clear();
+}
+
+//--------------------------------------------------------------
+void ofApp::logShutdown(const std::string & name, const ThreadPool::Report & report) {
+	if(report.cancelled > 0) {
+		ofLogWarning(PACKAGE) << name << " shutdown: " << report.drained << " task(s) drained, "
+		                      << report.cancelled << " cancelled after " << drainTimeout << " s";
+	}
+	else {
+		ofLogVerbose(PACKAGE) << name << " shutdown: " << report.drained << " task(s) drained, "
+		                      << report.completed << " completed in total";
+	}
+}
+
+//--------------------------------------------------------------
+bool ofApp::checkAllocations() {
+
+	// call the audio callback from a thread of our own instead of the sound
+	// stream, with buffers laid out as the stream's, noise to trigger one
+	// recording followed by silence until it's complete
+	soundStream.stop();
+	detector.enable();
+	audioRestarted = true;
+	std::size_t numChannels = inputChannel + 1;
+	ofSoundBuffer noise, silence;
+	noise.allocate(bufferSize * numChannels, numChannels);
+	silence.allocate(bufferSize * numChannels, numChannels);
+	for(auto & sample : noise.getBuffer()) {
+		sample = ofRandom(-1, 1);
+	}
+	std::thread audio([this, &noise, &silence]() {
+		for(std::size_t i = 0; i < numPreviousBuffers; i++) {
+			audioIn(noise);
+		}
+		for(std::size_t i = 0; i < numBuffers + numPreviousBuffers; i++) {
+			audioIn(silence);
+		}
+	});
+	audio.join();
+
+	// queue & classify as usual until the clip's result is processed
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+	while(clipQueue.popped == 0 || detector.getNumBusy() > 0) {
+		if(std::chrono::steady_clock::now() >= deadline) {
+			std::cout << "alloc check: audio & inference path: no clip classified" << std::endl;
+			return false;
+		}
+		update();
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	std::cout << "alloc check: audio & inference path: not caught, "
+	          << clipQueue.popped << " clip(s) classified" << std::endl;
+	return true;
 }
 
 //--------------------------------------------------------------
@@ -501,3 +1241,24 @@ std::string ofApp::resultToString(std::vector<float> outputVector) {
 	}
 	return result;
 }
+
+//--------------------------------------------------------------
+std::string ofApp::resultToJson(const std::string & selected, const std::vector<float> & outputVector) {
+	// labels are plain words, escape quotes & backslashes anyway
+	auto quote = [](const std::string & text) {
+		std::string quoted = "\"";
+		for(char c : text) {
+			if(c == '"' || c == '\\') {quoted += '\\';}
+			quoted += c;
+		}
+		return quoted + "\"";
+	};
+	std::string result = "{\"selected\":" + quote(selected) + ",\"scores\":{";
+	for(size_t i = 0; i < outputVector.size(); i++) {
+		result += quote(labelsMap[i]) + ":" + std::to_string(outputVector[i]);
+		if(i < outputVector.size()-1) {
+			result += ",";
+		}
+	}
+	return result + "}}";
+}
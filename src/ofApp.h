@@ -16,18 +16,24 @@
 #pragma once
 
 #include "ofMain.h"
-#include "ofxTensorFlow2.h"
 #include "ofxOsc.h"
 
+#include "config.h"
 #include "AudioClassifier.h"
+#include "Detector.h"
+#include "ClipQueue.h"
+#include "Coalescer.h"
+#include "CommandProcess.h"
+#include "ControlReceiver.h"
 #include "Labels.h"
-
-// autotools-style config.h defines
-#define PACKAGE "LanguageIdentifier"
-#define VERSION "0.3.0"
-#define DESCRIPTION "identifies spoken language from audio stream"
-
-class ThreadPool;
+#include "LatencyHistogram.h"
+#include "MemoryLock.h"
+#include "MetricsServer.h"
+#include "OscOutput.h"
+#include "OutputSink.h"
+#include "RtLog.h"
+#include "ThreadPool.h"
+#include "ThreadSettings.h"
 
 class ofApp : public ofBaseApp {
 
@@ -64,17 +70,80 @@ class ofApp : public ofBaseApp {
 		/// disable listening auto stop after detection
 		void disableAutostop();
 
-		/// osc receiver callback
+		/// osc control callback in the receiver thread, applies control
+		/// changes right away
+		void controlReceived(const ofxOscMessage &message);
+
+		/// osc receiver callback in the main thread, finishes control changes
 		void oscReceived(const ofxOscMessage &message);
 
+		/// inference result for a recorded clip, one per detector slot
+		typedef struct ClipResult {
+			int slot = -1; //< detector slot
+			int stream = 0; //< source stream
+			int argMax = 0;
+			float prob = 0;
+			std::vector<float> outputVector;
+			float wait = 0; //< queue wait in ms
+			float latency = 0; //< inference latency in ms, including replica wait
+			float idle = 0; //< seconds since any previous inference when started
+			ClipTiming timing; //< stage timestamps up to inference
+		} ClipResult;
+
+		/// classify up to batchSize queued clips, run in an inference thread
+		void classifyPending();
+
+		/// handle finished inference results in the main thread
+		void processResults();
+
+		/// handle inference result, sends osc and runs command on detection
+		void processResult(const ClipResult & result);
+
+		/// latency histograms by name, for /stats replies & the exit summary
+		std::vector<std::pair<std::string, LatencyHistogram*>> getHistograms();
+
+		/// Prometheus metrics text, called in the metrics server thread so
+		/// only reads counters which are safe to read from any thread
+		std::string getMetrics();
+
+		/// log clip stage durations & keep them for the exit summary
+		void logTiming(const ClipTiming & timing);
+
+		/// post current output event to all sinks, if set, then clear it
+		void postOutput();
+
+		/// log thread pool shutdown task counts
+		void logShutdown(const std::string & name, const ThreadPool::Report & report);
+
+		/// drive the audio callback & inference path with loud noise after
+		/// warm up until a clip is classified, in a DEBUG_ALLOC build any
+		/// allocation in either aborts, returns true if a clip was classified
+		bool checkAllocations();
+
 		/// convert model results into a key=value string seperated by spaces
 		std::string resultToString(std::vector<float> outputVector);
 
+		/// convert model results into a single line JSON object with the
+		/// selected label and a label: score object
+		std::string resultToJson(const std::string & selected, const std::vector<float> & outputVector);
+
 		// audio 
 		ofSoundStream soundStream;
 		int inputDevice = -1; // -1 means search for default device
 		int inputChannel = 0; // 0 - chan 1 (left), 1 - chan 2 (right), 2 - chan 3, etc
-		bool listening = true;
+		std::atomic<bool> listening{true};
+		RtLog audioLog; //< real-time safe log for the audio thread
+		ThreadSettings audioThread; //< audio callback thread priority, etc
+		ThreadStatus audioThreadStatus; // set by the audio thread on first callback
+		std::atomic<bool> audioThreadApplied{false}; // audio thread settings applied?
+		bool audioThreadReported = false; // audio thread settings logged?
+		std::atomic<bool> audioRestarted{true}; // reset callback timing on (re)start
+		std::chrono::steady_clock::time_point lastCallback; // audio thread only
+		float callbackInterval = 0; // expected ms between callbacks
+		std::atomic<uint64_t> xruns{0}; //< late audio callbacks, likely xruns
+		bool lockMemory = false; //< lock audio buffers & model input/output buffers into RAM, not the weights
+		bool lockAllMemory = false; //< lock all process memory, not just the registered buffers
+		bool allocTest = false; //< check the audio & inference paths for allocations after setup, then exit
 
 		// neural network input parameters
 		// for ease of use:
@@ -85,17 +154,16 @@ class ofApp : public ofBaseApp {
 		std::size_t sampleRate = 48000;
 		std::size_t downsamplingFactor = 3;
 
-		// since volume detection has some latency,d we keep a history of buffers
-		AudioBufferFifo previousBuffers;
+		// since volume detection has some latency, the detector keeps a history of buffers
+		Detector detector;
 		std::size_t numPreviousBuffers = 10; // how many buffers to save before trigger happens
-		// sampleBuffers acts as a buffer for recording (could be fused)
-		AudioBufferFifo sampleBuffers;
 		std::size_t numBuffers;
+		std::size_t numSlots = 0; //< clips which can be recorded, queued, or inferred at once, 0 for queue + replicas + 1
 		SimpleAudioBuffer monoBuffer; //< mono inputChannel stream buffer
+		std::string captureFormat = "float"; //< recorded sample format: "float", "int16", or "int16ds"
 		
 		// volume
-		float curVol = 0.0;
-		float smoothedVol = 0.0;
+		std::atomic<float> smoothedVol{0}; //< written by audio thread
 		float scaledVol = 0.0;
 		float volThreshold = 25;
 
@@ -105,18 +173,39 @@ class ofApp : public ofBaseApp {
 
 		// neural network	
 		AudioClassifier model;
-		cppflow::tensor output;
+		MemoryLock memoryLock; // declared after the detector & model so it unlocks before they free
+		SessionSettings sessionSettings; //< model session threading, etc
+		std::string graphCacheDir = ""; //< compiled graph cache, relative to bin/data
+		std::size_t replicas = 1; //< model session replicas for concurrent clips
+		std::size_t batchSize = 1; //< max pending clips classified in one run
+		std::string autotune = ""; //< autotune objective: "latency" or "throughput"
+		ThreadPool *inferencePool = nullptr; // background inference pool
+		ThreadSettings inferenceThread; //< inference worker thread priority, etc
+		ClipQueue clipQueue; // recorded clips waiting for inference
+		std::size_t queueSize = 4; //< max clips waiting for inference
+		std::string queuePolicy = "oldest"; //< full queue policy: "oldest", "newest", or "coalesce"
+		float keepWarm = 0; //< idle seconds before a keep warm inference, 0 to disable
+		bool preWarm = false; //< keep warm inference when volume starts rising
+		std::atomic<bool> warming{false}; // keep warm inference running?
+		std::atomic<float> lastInference{0}; // last inference time in seconds, any kind
+		float lastClip = 0; // last clip inference result time in seconds
+		std::mutex resultsMutex;
+		std::vector<ClipResult> slotResults; // inference results by detector slot
+		std::vector<int> finishedSlots; // slots with finished results to process
+		std::vector<float> latencies; // inference latency history in ms
+		std::vector<float> stageTimes[ClipTiming::NUM_STAGES]; // clip stage duration history in ms
+		bool outputTiming = false; //< add clip stage durations to output results
+		LatencyHistogram inferenceHistogram; // model run time, per inference thread
+		LatencyHistogram queueHistogram; // clip queue wait, per inference thread
+		LatencyHistogram resultHistogram; // trigger to result output, main thread
+		LatencyHistogram callbackHistogram; // audio callback duration, audio thread
 		std::size_t inputSeconds = 5;
 		std::size_t inputSize;
 		float minConfidence = 0.75;
 		static const std::size_t modelSampleRate; //< sample rate expected by model
 
 		// neural network control logic
-		std::size_t recordingCounter = 0;
-		bool trigger = false;
-		bool enable = true;
-		bool autostop = false;
-		bool recording = false;
+		std::atomic<bool> autostop{false};
 		bool blink = true; // recording blink state
 		float blinkTimestamp = 0; // blink timestamp
 
@@ -127,12 +216,37 @@ class ofApp : public ofBaseApp {
 			OscHost(std::string a, int p) : address(a), port(p) {}
 		} OscHost;
 		std::vector<OscHost> hosts = {};
-		std::vector<ofxOscSender*> senders;
-		ofxOscReceiver receiver;
+		OscOutput oscOutput; // background osc sender
+
+		// outputs
+		std::vector<std::string> outputs = {"osc"}; //< output sink specs
+		std::vector<std::unique_ptr<OutputSink>> sinks;
+		OutputEvent outputEvent; // event being built, posted by postOutput()
+		Coalescer coalescer; // suppresses repeated detections for outputs & commands
+		float coalesceWindow = 0; //< seconds to merge same language detections, 0 to disable
+		float keepalive = 10; //< seconds to resend a merged language, 0 to disable
+		ControlReceiver receiver; // osc control messages, handled in its own thread
+		std::atomic<bool> controlDropped{false}; // clip dropped by a control stop?
 		int port = 9898;
-		bool recordingStarted = false;
 
 		// optional command to run on detection
 		std::string command = "";
 		ThreadPool *commandPool = nullptr; // background command pool
+		std::size_t helperThreads = 2; //< command pool threads
+		ThreadSettings helperThread; //< command worker thread priority, etc
+		bool persistent = false; //< run command once, writing detections to its stdin
+		CommandProcess commandProcess; // persistent command child
+
+		// metrics
+		MetricsServer metricsServer; // prometheus scrapes, served in its own thread
+		int metricsPort = 0; //< localhost metrics port, 0 to disable
+		std::vector<std::string> metricsLabels; // label names by index, copied for the server thread
+		std::unique_ptr<std::atomic<uint64_t>[]> detections; // confident results by label, written by main thread
+		std::atomic<uint64_t> noiseRejections{0}; // results classified as noise, written by main thread
+		std::atomic<uint64_t> confidenceRejections{0}; // results below min confidence, written by main thread
+		int noiseIndex = -1; // noise label index, if any
+		float modelLoadTime = 0; // ms
+
+		// exit
+		float drainTimeout = 5; //< max seconds to finish queued inference & commands on exit
 };